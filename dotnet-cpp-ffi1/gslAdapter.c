@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include <gsl/gsl_sf_bessel.h>
 #include <gsl/gsl_complex.h>
 #include <gsl/gsl_complex_math.h>
@@ -167,3 +169,263 @@ void* cpl_pow(void* cplPtrA, void* cplPtrB){
 
 
 
+
+/// -------------- Batched Complex Functions (Structure of Arrays) ------------- //
+//
+// Each function operates on n complex numbers stored as two arrays,
+// one for the real parts and another for the imaginary parts, and writes
+// the result to arrays allocated by the caller. No memory is allocated,
+// thus a single call from .NET replaces n calls to the functions above
+// and n calls to malloc(). The output arrays may be the same as the input
+// arrays for in place computations.
+//
+// Arithmetic loops are auto-vectorized by the compiler when built with -O3.
+
+void cplv_add(size_t n
+              ,const double ar[], const double ai[]
+              ,const double br[], const double bi[]
+              ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    outr[i] = ar[i] + br[i];
+    outi[i] = ai[i] + bi[i];
+  }
+}
+
+void cplv_sub(size_t n
+              ,const double ar[], const double ai[]
+              ,const double br[], const double bi[]
+              ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    outr[i] = ar[i] - br[i];
+    outi[i] = ai[i] - bi[i];
+  }
+}
+
+void cplv_mul(size_t n
+              ,const double ar[], const double ai[]
+              ,const double br[], const double bi[]
+              ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    double re = ar[i] * br[i] - ai[i] * bi[i];
+    double im = ar[i] * bi[i] + ai[i] * br[i];
+    outr[i] = re;
+    outi[i] = im;
+  }
+}
+
+// Same algorithm as gsl_complex_div(), which scales by 1/|b|
+// in order to avoid overflow.
+// 
+void cplv_div(size_t n
+              ,const double ar[], const double ai[]
+              ,const double br[], const double bi[]
+              ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    double s   = 1.0 / hypot(br[i], bi[i]);
+    double sbr = s * br[i];
+    double sbi = s * bi[i];
+    double re  = (ar[i] * sbr + ai[i] * sbi) * s;
+    double im  = (ai[i] * sbr - ar[i] * sbi) * s;
+    outr[i] = re;
+    outi[i] = im;
+  }
+}
+
+// out = a * x, where x is a real number. 
+// 
+void cplv_mul_real(size_t n, const double ar[], const double ai[], double x
+                   ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    outr[i] = ar[i] * x;
+    outi[i] = ai[i] * x;
+  }
+}
+
+// Computes the modulus |a| of each number 
+// 
+void cplv_abs(size_t n, const double ar[], const double ai[], double out[]){
+  for(size_t i = 0; i < n; i++){
+    out[i] = hypot(ar[i], ai[i]);
+  }
+}
+
+// Applies a GSL complex function to each element. The gsl_complex
+// values are passed by value, on the stack.
+// 
+static void cplv_apply(gsl_complex (*fun) (gsl_complex), size_t n
+                       ,const double ar[], const double ai[]
+                       ,double outr[], double outi[]){
+  for(size_t i = 0; i < n; i++){
+    gsl_complex z = fun(gsl_complex_rect(ar[i], ai[i]));
+    outr[i] = GSL_REAL(z);
+    outi[i] = GSL_IMAG(z);
+  }
+}
+
+void cplv_sqrt(size_t n, const double ar[], const double ai[]
+               ,double outr[], double outi[]){
+  cplv_apply(gsl_complex_sqrt, n, ar, ai, outr, outi);
+}
+
+void cplv_exp(size_t n, const double ar[], const double ai[]
+              ,double outr[], double outi[]){
+  cplv_apply(gsl_complex_exp, n, ar, ai, outr, outi);
+}
+
+void cplv_log10(size_t n, const double ar[], const double ai[]
+                ,double outr[], double outi[]){
+  cplv_apply(gsl_complex_log10, n, ar, ai, outr, outi);
+}
+
+
+/// -------------- Arena for Scalar Complex Functions ------------- //
+//
+// The arena allocates gsl_complex numbers from large blocks, so the
+// scalar functions cplArena_* do not need to call malloc() for each
+// result and the caller does not need to free each number. All numbers
+// allocated from an arena are released at once by cplArenaReset() or
+// cplArenaDelete(). Pointers remain valid until then as blocks are never
+// moved.
+//
+// Note: An arena is not thread-safe, use one arena per thread.
+
+typedef struct CplArenaBlock {
+  struct CplArenaBlock* next;
+  size_t                used;
+  size_t                capacity;
+  gsl_complex           data[];
+} CplArenaBlock;
+
+typedef struct {
+  CplArenaBlock* head;
+  size_t         blockSize;
+} CplArena;
+
+static CplArenaBlock* cplArenaBlockNew(size_t capacity, CplArenaBlock* next){
+  CplArenaBlock* block = malloc(sizeof(CplArenaBlock) + capacity * sizeof(gsl_complex));
+  if(block == NULL) return NULL;
+  block->next     = next;
+  block->used     = 0;
+  block->capacity = capacity;
+  return block;
+}
+
+// Create an arena, blockSize is the number of complex numbers per block.
+// Returns NULL if the allocation fails.
+// 
+void* cplArenaNew(size_t blockSize){
+  CplArena* arena = malloc(sizeof(CplArena));
+  if(arena == NULL) return NULL;
+  arena->blockSize = blockSize > 0 ? blockSize : 4096;
+  arena->head      = cplArenaBlockNew(arena->blockSize, NULL);
+  if(arena->head == NULL){
+    free(arena);
+    return NULL;
+  }
+  return (void *) arena;
+}
+
+// Release all numbers allocated by the arena, but keep the first
+// block for reuse.
+//
+void cplArenaReset(void* arenaPtr){
+  CplArena* arena = (CplArena *) arenaPtr;
+  CplArenaBlock* block = arena->head->next;
+  while(block != NULL){
+    CplArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head->next = NULL;
+  arena->head->used = 0;
+}
+
+void cplArenaDelete(void* arenaPtr){
+  CplArena* arena = (CplArena *) arenaPtr;
+  if(arena == NULL) return;
+  cplArenaReset(arena);
+  free(arena->head);
+  free(arena);
+}
+
+// Number of complex numbers currently allocated from the arena 
+//
+size_t cplArenaSize(void* arenaPtr){
+  CplArena* arena = (CplArena *) arenaPtr;
+  size_t size = 0;
+  for(CplArenaBlock* block = arena->head; block != NULL; block = block->next)
+    size += block->used;
+  return size;
+}
+
+// Copy the number z into the arena and return a pointer to it.
+// Returns NULL if a new block cannot be allocated.
+// 
+static void* cplArenaPush(void* arenaPtr, gsl_complex z){
+  CplArena* arena = (CplArena *) arenaPtr;
+  CplArenaBlock* block = arena->head;
+  if(block->used == block->capacity){
+    block = cplArenaBlockNew(arena->blockSize, arena->head);
+    if(block == NULL) return NULL;
+    arena->head = block;
+  }
+  gsl_complex* result = &block->data[block->used++];
+  *result = z;
+  return (void *) result;
+}
+
+void* cplArena_rect(void* arena, double x, double y){
+  return cplArenaPush(arena, gsl_complex_rect(x, y));
+}
+
+void* cplArena_polar(void* arena, double r, double theta){
+  return cplArenaPush(arena, gsl_complex_polar(r, theta));
+}
+
+void* cplArena_add(void* arena, void* cplPtrA, void* cplPtrB){
+  return cplArenaPush(arena, gsl_complex_add(*void2cpl(cplPtrA), *void2cpl(cplPtrB)));
+}
+
+void* cplArena_sub(void* arena, void* cplPtrA, void* cplPtrB){
+  return cplArenaPush(arena, gsl_complex_sub(*void2cpl(cplPtrA), *void2cpl(cplPtrB)));
+}
+
+void* cplArena_mul(void* arena, void* cplPtrA, void* cplPtrB){
+  return cplArenaPush(arena, gsl_complex_mul(*void2cpl(cplPtrA), *void2cpl(cplPtrB)));
+}
+
+void* cplArena_div(void* arena, void* cplPtrA, void* cplPtrB){
+  return cplArenaPush(arena, gsl_complex_div(*void2cpl(cplPtrA), *void2cpl(cplPtrB)));
+}
+
+void* cplArena_add_real(void* arena, void* cplPtrA, double x){
+  return cplArenaPush(arena, gsl_complex_add_real(*void2cpl(cplPtrA), x));
+}
+
+void* cplArena_sub_real(void* arena, void* cplPtrA, double x){
+  return cplArenaPush(arena, gsl_complex_sub_real(*void2cpl(cplPtrA), x));
+}
+
+void* cplArena_mul_real(void* arena, void* cplPtrA, double x){
+  return cplArenaPush(arena, gsl_complex_mul_real(*void2cpl(cplPtrA), x));
+}
+
+void* cplArena_div_real(void* arena, void* cplPtrA, double x){
+  return cplArenaPush(arena, gsl_complex_div_real(*void2cpl(cplPtrA), x));
+}
+
+void* cplArena_sqrt(void* arena, void* cplPtrA){
+  return cplArenaPush(arena, gsl_complex_sqrt(*void2cpl(cplPtrA)));
+}
+
+void* cplArena_exp(void* arena, void* cplPtrA){
+  return cplArenaPush(arena, gsl_complex_exp(*void2cpl(cplPtrA)));
+}
+
+void* cplArena_log10(void* arena, void* cplPtrA){
+  return cplArenaPush(arena, gsl_complex_log10(*void2cpl(cplPtrA)));
+}
+
+void* cplArena_pow(void* arena, void* cplPtrA, void* cplPtrB){
+  return cplArenaPush(arena, gsl_complex_pow(*void2cpl(cplPtrA), *void2cpl(cplPtrB)));
+}
@@ -2,6 +2,7 @@
 #include <cmath>
 #include <vector>
 #include <iterator>
+#include <algorithm>
 
 // #include "hpc.hpp"
 
@@ -23,6 +24,17 @@ extern "C" { void genArray2(double* arr, int size); }
 
 extern "C" {double vectorSum(double xs [], size_t n); }
 
+/// Zero-copy API: operates directly on caller-owned buffers (arrays
+/// pinned by .NET marshalling, Haskell Ptr Double, numpy arrays ...)
+/// without copying them into a std::vector.
+extern "C" {
+  double spanSum  (const double xs [], size_t n);
+  double spanNorm (const double xs [], size_t n);
+  double spanDot  (const double xs [], const double ys [], size_t n);
+  void   spanScale(double xs [], size_t n, double factor);
+  void   spanAxpy (double a, const double xs [], double ys [], size_t n);
+}
+
 /// C-wrapper for the circle class 
 extern "C" {
   void  *Circle_new    (double radius);
@@ -92,29 +104,103 @@ double vectorNorm(vector<double> &xs){
 //
 // extern "C" { double vectorNorm(double [], int) ; }
 //
+// Note: It used to copy the array into a vector with arrayToVector2,
+// now it computes the norm in place. A negative size from the caller
+// returns NaN, instead of being converted to a huge size_t.
+//
 double vectorNorm(double xs [], int n){
-  //vector<double> v = arrayToVector(xs, n);
-  vector<double> v = arrayToVector2(xs, n);
-  return vectorNorm(v);
+  if(n < 0)
+    return std::nan("");
+  return spanNorm(xs, static_cast<size_t>(n));
 }
 
 double vectorSum(vector<double> &xs){
-  double sum = 0.0 ;
-  for (size_t i = 0; i < xs.size(); i++){
-    sum = sum + xs.at(i);
-  }
+  return spanSum(xs.data(), xs.size());
 }
 
 // C-wrapper for vectorSum 
 // 
 double vectorSum(double xs [], size_t n){
-  vector<double>v(n);
-  double* p = v.data();
-  p = xs;
-  return vectorSum(v);  
+  return spanSum(xs, n);
+}
+
+
+
+
+// Non-owning view of a contiguous array of doubles, similar to C++20
+// std::span<double>. It allows the C++ code to work on the caller's
+// memory without any copy.
+//
+template<typename T>
+struct Span{
+  T*     data;
+  size_t size;
+
+  Span(T* data, size_t size): data(data), size(size) { }
+  T* begin() const { return data; }
+  T* end()   const { return data + size; }
+  T& operator[](size_t i) const { return data[i]; }
+};
+
+// Inner loops annotated with "omp simd" are vectorized by the compiler
+// when compiling with -fopenmp-simd (without linking OpenMP runtime).
+// The reduction clause allows the compiler to reorder the sum using
+// several vector accumulators, what is not allowed otherwise
+// as float point addition is not associative.
+//
+double spanSum(Span<const double> xs){
+  double acc = 0.0;
+  #pragma omp simd reduction(+:acc)
+  for (size_t i = 0; i < xs.size; i++){
+    acc += xs[i];
+  }
+  return acc;
 }
 
+double spanDot(Span<const double> xs, Span<const double> ys){
+  double acc = 0.0;
+  size_t n = std::min(xs.size, ys.size);
+  #pragma omp simd reduction(+:acc)
+  for (size_t i = 0; i < n; i++){
+    acc += xs[i] * ys[i];
+  }
+  return acc;
+}
+
+void spanScale(Span<double> xs, double factor){
+  #pragma omp simd
+  for (size_t i = 0; i < xs.size; i++){
+    xs[i] *= factor;
+  }
+}
+
+// C-wrappers for the Span functions
+//
+double spanSum(const double xs [], size_t n){
+  return spanSum(Span<const double>(xs, n));
+}
 
+double spanNorm(const double xs [], size_t n){
+  Span<const double> v(xs, n);
+  return sqrt(spanDot(v, v));
+}
+
+double spanDot(const double xs [], const double ys [], size_t n){
+  return spanDot(Span<const double>(xs, n), Span<const double>(ys, n));
+}
+
+// Multiply all elements of xs by factor (in place)
+void spanScale(double xs [], size_t n, double factor){
+  spanScale(Span<double>(xs, n), factor);
+}
+
+// ys <- a * xs + ys (in place, BLAS daxpy)
+void spanAxpy(double a, const double xs [], double ys [], size_t n){
+  #pragma omp simd
+  for (size_t i = 0; i < n; i++){
+    ys[i] += a * xs[i];
+  }
+}
 
 vector<double> vectorScale(vector<double> &xs, double scale){
   vector<double> ys;
@@ -1,7 +1,16 @@
-
+#include <cstddef>
 
 extern "C" {  double vector2DNorm(double x, double y);  }
 
+// Zero-copy functions operating on caller-owned buffers
+extern "C" {
+  double spanSum  (const double xs [], size_t n);
+  double spanNorm (const double xs [], size_t n);
+  double spanDot  (const double xs [], const double ys [], size_t n);
+  void   spanScale(double xs [], size_t n, double factor);
+  void   spanAxpy (double a, const double xs [], double ys [], size_t n);
+}
+
 
 
 
@@ -1,10 +1,18 @@
 // Author: Caio Rodrigues
 // Brief:  Demonstration and testing of boost pointer container.
+//
+// Compile with:
+//  $ g++ boost-pointer-container.cpp -o boost-pointer-container.bin -std=c++1z -O2 -Wall -Wextra
 //---------------------------------------------------------------------
 #include <iostream>
 #include <vector>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <chrono>
+#include <type_traits>
 
 #include <boost/ptr_container/ptr_vector.hpp>
 
@@ -14,6 +22,8 @@ public:
 		static int i = 0;
 		return ++i;
 	}		
+	// Disable destructor messages (used by benchmarks)
+	static inline bool verbose = true;
 	
 	Base() = default;
 	// Destructor of base class must always be virtual
@@ -26,7 +36,7 @@ public:
 };
 
 
-class DerivedA: public Base{	
+class DerivedA final: public Base{	
 public:
 	const int m_id;
 	
@@ -38,13 +48,14 @@ public:
 		return m_id;
 	}	
 	~DerivedA(){
-		std::cout << " [INFO] Class DerivedA deleted. => Object ID = "
-				  << m_id << "\n";
+		if(Base::verbose)
+			std::cout << " [INFO] Class DerivedA deleted. => Object ID = "
+					  << m_id << "\n";
 	}
 };
 
 
-class DerivedB: public Base{
+class DerivedB final: public Base{
 	const int m_id;
 public:		
 	DerivedB(): m_id(Base::nextID())  { }
@@ -55,12 +66,81 @@ public:
 		return m_id;
 	}		
 	~DerivedB(){
-		std::cout << " [INFO] Class DerivedB deleted. => ObjectID = "
-				  << m_id  << "\n";
+		if(Base::verbose)
+			std::cout << " [INFO] Class DerivedB deleted. => ObjectID = "
+					  << m_id  << "\n";
+	}
+};
+
+
+/** Polymorphic container which stores objects of each derived type
+ *  contiguously, by value, in a separate std::vector (type-segregated
+ *  storage), instead of one heap allocation per element.
+ *
+ *  for_each() iterates over the objects grouped by concrete type, calling
+ *  the function with the derived type. So, if the derived classes are final,
+ *  the compiler devirtualizes (and may inline) the virtual calls.
+ *  The insertion order is only preserved among objects of the same type.
+ *
+ *  Note: Like std::vector, insertion may invalidate references and
+ *  relocate the objects (move or copy, then destroy the old ones), so
+ *  call reserve() if destructors have side effects.
+ */
+template<typename Base, typename... Derived>
+class poly_vector{
+	static_assert(std::conjunction<std::is_base_of<Base, Derived>...>::value,
+				  "All types must derive from Base");
+public:
+	template<typename T, typename... Args>
+	auto emplace(Args&&... args) -> T& {
+		return storage<T>().emplace_back(std::forward<Args>(args)...);
+	}
+	template<typename T>
+	auto reserve(size_t n) -> void {
+		storage<T>().reserve(n);
+	}
+	template<typename T>
+	auto storage() -> std::vector<T>& {
+		return std::get<std::vector<T>>(m_data);
+	}
+	template<typename T>
+	auto storage() const -> const std::vector<T>& {
+		return std::get<std::vector<T>>(m_data);
+	}
+	auto size() const -> size_t {
+		return (storage<Derived>().size() + ...);
+	}
+	auto empty() const -> bool {
+		return this->size() == 0;
+	}
+	auto clear() -> void {
+		(storage<Derived>().clear(), ...);
+	}
+	/// Call function for every object with its concrete type, one batch
+	/// (tight loop) per type.
+	template<typename Function>
+	auto for_each(Function&& fn) -> void {
+		(for_each_in(storage<Derived>(), fn), ...);
+	}
+	template<typename Function>
+	auto for_each(Function&& fn) const -> void {
+		(for_each_in(storage<Derived>(), fn), ...);
+	}
+	/// Call function for every object through a reference to the base class.
+	template<typename Function>
+	auto for_each_base(Function&& fn) const -> void {
+		this->for_each([&fn](const Base& obj){ fn(obj); });
+	}
+private:
+	std::tuple<std::vector<Derived>...> m_data;
+
+	template<typename Vector, typename Function>
+	static auto for_each_in(Vector& xs, Function& fn) -> void {
+		for(auto& x: xs)
+			fn(x);
 	}
 };
 
-	
 void showType(Base const& obj)
 {
 	std::cout << "Object ID = " << obj.getID()
@@ -68,6 +148,77 @@ void showType(Base const& obj)
 			  << "\n";
 }
 
+template<typename Function>
+auto timeIt(Function fn) -> double {
+	auto t0 = std::chrono::steady_clock::now();
+	fn();
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// Fill container with objects, sum the IDs and destroy it.
+template<typename Container, typename Build, typename Iterate>
+auto benchmarkContainer(const char* label, Build build, Iterate iterate) -> void {
+	long sum = 0;
+	auto container  = std::make_unique<Container>();
+	double tBuild   = timeIt([&]{ build(*container); });
+	double tIterate = timeIt([&]{ sum = iterate(*container); });
+	double tDestroy = timeIt([&]{ container.reset(); });
+	std::cout << " " << label
+			  << " build = "     << tBuild   << " ms"
+			  << " ; iterate = " << tIterate << " ms"
+			  << " ; destroy = " << tDestroy << " ms"
+			  << " (sum = " << sum << ")" << "\n";
+}
+
+auto benchmark(size_t n) -> void {
+	Base::verbose = false;
+	std::cout << " Number of objects = " << n << "\n";
+
+	benchmarkContainer<boost::ptr_vector<Base>>("boost::ptr_vector<Base>          ",
+		[n](boost::ptr_vector<Base>& xs){
+			xs.reserve(n);
+			for(size_t i = 0; i < n; i++)
+				if(i % 2 == 0) xs.push_back(new DerivedA);
+				else           xs.push_back(new DerivedB);
+		},
+		[](const boost::ptr_vector<Base>& xs){
+			long sum = 0;
+			for(const auto& x: xs) sum += x.getID();
+			return sum;
+		});
+
+	benchmarkContainer<std::vector<std::unique_ptr<Base>>>("std::vector<unique_ptr<Base>>    ",
+		[n](std::vector<std::unique_ptr<Base>>& xs){
+			xs.reserve(n);
+			for(size_t i = 0; i < n; i++)
+				if(i % 2 == 0) xs.push_back(std::make_unique<DerivedA>());
+				else           xs.push_back(std::make_unique<DerivedB>());
+		},
+		[](const std::vector<std::unique_ptr<Base>>& xs){
+			long sum = 0;
+			for(const auto& x: xs) sum += x->getID();
+			return sum;
+		});
+
+	using PolyVector = poly_vector<Base, DerivedA, DerivedB>;
+	benchmarkContainer<PolyVector>("poly_vector<Base, DerivedA, ...> ",
+		[n](PolyVector& xs){
+			xs.reserve<DerivedA>(n / 2 + 1);
+			xs.reserve<DerivedB>(n / 2 + 1);
+			for(size_t i = 0; i < n; i++)
+				if(i % 2 == 0) xs.emplace<DerivedA>();
+				else           xs.emplace<DerivedB>();
+		},
+		[](const PolyVector& xs){
+			long sum = 0;
+			// Calls are devirtualized: the argument has the concrete type
+			xs.for_each([&sum](const auto& x){ sum += x.getID(); });
+			return sum;
+		});
+	Base::verbose = true;
+}
+
 int main(){
 
 	std::cout << "\n === EXPERIMENT 0 ==============================" << "\n";
@@ -128,6 +279,23 @@ int main(){
 	ps.pop_back();
 	std::for_each(ps.begin(), ps.end(), showType);
 
+	std::cout << "\n === EXPERIMENT 3 - poly_vector ===================" << "\n";
+	{
+		poly_vector<Base, DerivedA, DerivedB> pv;
+		// Reserve, otherwise reallocation copies the objects and destroys
+		// the old copies, printing destructor messages of live objects.
+		pv.reserve<DerivedA>(2);
+		pv.reserve<DerivedB>(1);
+		pv.emplace<DerivedA>();
+		pv.emplace<DerivedB>();
+		pv.emplace<DerivedA>();
+		std::cout << " Number of objects = " << pv.size() << "\n";
+		pv.for_each_base(showType);
+	}
+
+	std::cout << "\n === EXPERIMENT 4 - Benchmark ====================" << "\n";
+	benchmark(2000000);
+
 	std::cout << " ============= END =================" << "\n";
 	
 	return 0;
@@ -0,0 +1,686 @@
+// Brief:  Composite Design Pattern - Data-oriented scene graph versus
+//         pointer-based composite (shared_ptr<IGraphic> tree).
+// Author: Caio Rodrigues
+//
+// The pointer-based composite of composite1.cpp allocates every node on the
+// heap and traverses the tree through virtual calls. The flat Scene class
+// stores the same hierarchy in contiguous arrays:
+//
+//  + Nodes are identified by handles (indices) and stored in depth-first
+//    order, so the subtree of any node is the contiguous range of nodes
+//    [handle, subtreeEnd[handle]).
+//  + Shapes of the same type are stored in homogeneous batches (structure
+//    of arrays of point coordinates), also in depth-first order, so the
+//    shapes of a subtree are contiguous ranges of each batch.
+//
+// Thus rotating a group is a linear loop over arrays of coordinates that
+// the compiler can vectorize, instead of a recursive traversal.
+//
+// The pointer-based Group defers transformations: rotate() marks the
+// subtree as dirty and update() only visits dirty subtrees, processing
+// large ones in parallel on a work-stealing thread pool.
+//
+// Compile with:
+//  $ g++ composite2.cpp -o composite2.bin -std=c++1z -O3 -march=native -pthread -Wall -Wextra
+//----------------------------------------------
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//======== Work-stealing thread pool ============//
+
+/// Each worker owns a deque of tasks: it pushes and pops tasks at the back
+/// of its own deque (LIFO, cache friendly) and, when it runs out of work,
+/// steals tasks from the front of the other deques. Tasks submitted from
+/// threads outside the pool go to an extra shared deque.
+class WorkStealingPool{
+public:
+	using Task = std::function<void ()>;
+
+	explicit WorkStealingPool(size_t nthreads = std::thread::hardware_concurrency())
+	{
+		nthreads = std::max<size_t>(nthreads, 1);
+		for(size_t i = 0; i < nthreads + 1; i++)
+			m_queues.emplace_back(new Queue);
+		for(size_t i = 0; i < nthreads; i++)
+			m_workers.emplace_back([this, i]{ this->workerLoop(i); });
+	}
+	~WorkStealingPool(){
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stop = true;
+		}
+		m_wakeup.notify_all();
+		for(auto& th: m_workers)
+			th.join();
+	}
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator= (const WorkStealingPool&) = delete;
+
+	auto size() const -> size_t { return m_workers.size(); }
+
+	auto submit(Task task) -> void {
+		Queue& q = *m_queues[this->currentIndex()];
+		{
+			std::lock_guard<std::mutex> lock(q.mutex);
+			q.tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_queued++;
+		}
+		m_wakeup.notify_one();
+	}
+
+	/// Run a single pending task, either from the queue of the calling
+	/// thread or stolen from another queue. Returns false if there was
+	/// no task to run. Used by threads waiting for tasks to complete.
+	auto runPending() -> bool {
+		Task task;
+		if(!this->take(this->currentIndex(), task))
+			return false;
+		task();
+		return true;
+	}
+
+private:
+	struct Queue{
+		std::mutex       mutex;
+		std::deque<Task> tasks;
+	};
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<std::thread>            m_workers;
+	std::mutex                          m_sleepMutex;
+	std::condition_variable             m_wakeup;
+	size_t                              m_queued = 0;
+	bool                                m_stop   = false;
+
+	// Index of the queue owned by the current thread in this pool
+	static thread_local const WorkStealingPool* t_pool;
+	static thread_local size_t                  t_index;
+
+	auto currentIndex() const -> size_t {
+		return t_pool == this ? t_index : m_workers.size();
+	}
+
+	auto take(size_t self, Task& task) -> bool {
+		// Own queue: newest task first
+		{
+			Queue& q = *m_queues[self];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if(!q.tasks.empty()){
+				task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+				return this->consumed();
+			}
+		}
+		// Steal the oldest task (usually the largest chunk of work)
+		for(size_t k = 1; k < m_queues.size(); k++){
+			Queue& q = *m_queues[(self + k) % m_queues.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+			if(!q.tasks.empty()){
+				task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+				return this->consumed();
+			}
+		}
+		return false;
+	}
+	auto consumed() -> bool {
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued--;
+		return true;
+	}
+
+	auto workerLoop(size_t index) -> void {
+		t_pool  = this;
+		t_index = index;
+		for(;;){
+			if(this->runPending())
+				continue;
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_wakeup.wait(lock, [this]{ return m_stop || m_queued > 0; });
+			if(m_stop) return;
+		}
+	}
+};
+
+thread_local const WorkStealingPool* WorkStealingPool::t_pool  = nullptr;
+thread_local size_t                  WorkStealingPool::t_index = 0;
+
+/// Fork-join helper: wait() blocks until all tasks started with run()
+/// finish, executing pending tasks of the pool meanwhile, so that nested
+/// task groups do not deadlock.
+class TaskGroup{
+public:
+	explicit TaskGroup(WorkStealingPool& pool): m_pool(pool) { }
+	~TaskGroup(){ this->wait(); }
+
+	template<typename Function>
+	auto run(Function fn) -> void {
+		m_count++;
+		m_pool.submit([this, fn]{
+			fn();
+			m_count--;
+		});
+	}
+	auto wait() -> void {
+		while(m_count > 0)
+			if(!m_pool.runPending())
+				std::this_thread::yield();
+	}
+private:
+	WorkStealingPool& m_pool;
+	std::atomic<int>  m_count{0};
+};
+
+//======== Pointer-based composite (baseline) ============//
+
+class Group;
+
+class IGraphic{
+public:
+	virtual auto type() const -> const std::string  = 0;
+	virtual auto draw(std::ostream& os) const -> void = 0;
+	virtual auto rotate(double) -> void = 0;
+	// Sum of all coordinates, used to compare implementations
+	virtual auto checksum() const -> double = 0;
+	// Number of nodes of the subtree
+	virtual auto count() const -> size_t { return 1; }
+	// Apply transformation inherited from ancestors and pending
+	// transformations of dirty descendants.
+	virtual auto applyPending(double inherited, WorkStealingPool*) -> void {
+		if(inherited != 0.0) this->rotate(inherited);
+	}
+	virtual auto setParent(Group*) -> void { }
+	virtual auto isDirty() const -> bool { return false; }
+	virtual ~IGraphic() = default;
+};
+
+using cstring = const char*;
+using GNode = std::shared_ptr<IGraphic>;
+
+/// Rotate point (x, y) around the origin, given cos(angle) and sin(angle)
+inline auto rotatePoint(double& x, double& y, double c, double s) -> void {
+	double xr = c * x - s * y;
+	double yr = s * x + c * y;
+	x = xr;
+	y = yr;
+}
+
+/** Group with deferred (incremental) transformations.
+ *
+ *  Group::rotate() is O(depth): it only accumulates the angle and marks the
+ *  group and its ancestors as dirty. The transformations are applied by
+ *  update(), which skips clean subtrees, so the cost is proportional to the
+ *  size of the changed subtrees instead of the whole tree. Large parts of
+ *  the dirty subtrees can be updated in parallel on a work-stealing pool.
+ *
+ *  Invariant: if a group is dirty, all its ancestors are dirty.
+ */
+class Group: public IGraphic{
+private:
+	std::vector<GNode> _nodes;
+	static constexpr cstring _type = "Group";
+	Group*             _parent  = nullptr;
+	size_t             _count   = 1;
+	double             _pending = 0.0;
+	bool               _dirty   = false;
+public:
+	/// Minimum number of nodes processed by a single task
+	static constexpr size_t parallelGrain = 8192;
+
+	/// Rotations requested before add() but not applied by update() yet
+	/// do not affect the new node.
+	auto add(GNode n) -> void {
+		n->setParent(this);
+		double pending = 0.0;
+		for(Group* g = this; g != nullptr; g = g->_parent){
+			g->_count += n->count();
+			pending   += g->_pending;
+		}
+		// Compensate the angle that update() will propagate to the node
+		if(pending != 0.0)
+			n->rotate(-pending);
+		// Keep the invariant when a dirty subtree is added to a clean group
+		if(n->isDirty())
+			for(Group* g = this; g != nullptr && !g->_dirty; g = g->_parent)
+				g->_dirty = true;
+		_nodes.push_back(std::move(n));
+	}
+	auto type() const -> const std::string override {
+		return _type;
+	}
+	auto draw(std::ostream& os) const -> void override {
+		os << " Group {" << "\n";
+		for(const auto& obj: _nodes)
+			obj->draw(os);
+		os << " }" << "\n";
+	}
+	auto rotate(double angle) -> void override {
+		_pending += angle;
+		for(Group* g = this; g != nullptr && !g->_dirty; g = g->_parent)
+			g->_dirty = true;
+	}
+	/// Apply pending transformations of this subtree. If pool is not null,
+	/// large subtrees are processed in parallel.
+	auto update(WorkStealingPool* pool = nullptr) -> void {
+		this->applyPending(0.0, pool);
+	}
+	auto isDirty() const -> bool override { return _dirty; }
+	auto checksum() const -> double override {
+		double sum = 0.0;
+		for(const auto& obj: _nodes)
+			sum += obj->checksum();
+		return sum;
+	}
+	auto count() const -> size_t override { return _count; }
+	auto setParent(Group* parent) -> void override { _parent = parent; }
+
+	auto applyPending(double inherited, WorkStealingPool* pool) -> void override {
+		double angle = inherited + _pending;
+		if(angle == 0.0 && !_dirty)
+			return;
+		_pending = 0.0;
+		_dirty   = false;
+		if(pool == nullptr || _count < 2 * parallelGrain){
+			for(const auto& obj: _nodes)
+				obj->applyPending(angle, nullptr);
+			return;
+		}
+		// Split children into chunks of at least parallelGrain nodes,
+		// big children are split recursively by their own tasks.
+		TaskGroup tasks(*pool);
+		size_t first = 0, nodes = 0;
+		for(size_t i = 0; i < _nodes.size(); i++){
+			if(angle == 0.0 && !_nodes[i]->isDirty())
+				continue;
+			nodes += _nodes[i]->count();
+			if(nodes < parallelGrain)
+				continue;
+			size_t last = i + 1;
+			tasks.run([this, first, last, angle, pool]{
+				for(size_t k = first; k < last; k++)
+					_nodes[k]->applyPending(angle, _nodes[k]->count() >= 2 * parallelGrain ? pool : nullptr);
+			});
+			first = last;
+			nodes = 0;
+		}
+		// Remaining small chunk runs on the current thread
+		for(size_t k = first; k < _nodes.size(); k++)
+			_nodes[k]->applyPending(angle, nullptr);
+		tasks.wait();
+	}
+};
+
+class Line: public IGraphic {
+private:
+	static constexpr cstring _type = "Line";
+	double _x0, _y0, _x1, _y1;
+public:
+	Line(double x0, double y0, double x1, double y1)
+		: _x0(x0), _y0(y0), _x1(x1), _y1(y1) { }
+	auto type() const -> const std::string override {
+		return _type;
+	}
+	auto draw(std::ostream& os) const -> void override {
+		os << "  Line (" << _x0 << ", " << _y0 << ") -> (" << _x1 << ", " << _y1 << ")\n";
+	}
+	auto rotate(double angle) -> void override {
+		double c = std::cos(angle), s = std::sin(angle);
+		rotatePoint(_x0, _y0, c, s);
+		rotatePoint(_x1, _y1, c, s);
+	}
+	auto checksum() const -> double override {
+		return _x0 + _y0 + _x1 + _y1;
+	}
+};
+
+class Triangle: public IGraphic {
+private:
+	static constexpr cstring _type = "Triangle";
+	double _x[3], _y[3];
+public:
+	Triangle(double x0, double y0, double x1, double y1, double x2, double y2)
+		: _x{x0, x1, x2}, _y{y0, y1, y2} { }
+	auto type() const -> const std::string override {
+		return _type;
+	}
+	auto draw(std::ostream& os) const -> void override {
+		os << "  Triangle";
+		for(int i = 0; i < 3; i++)
+			os << " (" << _x[i] << ", " << _y[i] << ")";
+		os << "\n";
+	}
+	auto rotate(double angle) -> void override {
+		double c = std::cos(angle), s = std::sin(angle);
+		for(int i = 0; i < 3; i++)
+			rotatePoint(_x[i], _y[i], c, s);
+	}
+	auto checksum() const -> double override {
+		return _x[0] + _x[1] + _x[2] + _y[0] + _y[1] + _y[2];
+	}
+};
+
+//======== Data-oriented flat scene ============//
+
+/// Homogeneous batch of shapes with a fixed number of points, stored as
+/// structure of arrays. The points of shape i are at indices
+/// [i * pointsPerShape, (i + 1) * pointsPerShape).
+struct PointBatch{
+	size_t              pointsPerShape;
+	std::vector<double> x;
+	std::vector<double> y;
+
+	explicit PointBatch(size_t n): pointsPerShape(n) { }
+	auto size() const -> size_t { return x.size() / pointsPerShape; }
+
+	/// Rotate shapes [first, last) - linear loop, vectorized by the compiler
+	auto rotate(size_t first, size_t last, double angle) -> void {
+		const double c = std::cos(angle), s = std::sin(angle);
+		double* px = x.data();
+		double* py = y.data();
+		const size_t end = last * pointsPerShape;
+		for(size_t i = first * pointsPerShape; i < end; i++){
+			double xr = c * px[i] - s * py[i];
+			double yr = s * px[i] + c * py[i];
+			px[i] = xr;
+			py[i] = yr;
+		}
+	}
+	auto checksum(size_t first, size_t last) const -> double {
+		double sum = 0.0;
+		for(size_t i = first * pointsPerShape; i < last * pointsPerShape; i++)
+			sum += x[i] + y[i];
+		return sum;
+	}
+};
+
+class Scene{
+public:
+	using Handle = uint32_t;
+	enum class Kind: uint8_t { Group, Line, Triangle };
+	static constexpr Handle none = UINT32_MAX;
+
+	Scene(): m_lines(2), m_triangles(3) { }
+
+	/// Open a group, the following nodes are added to this group
+	/// until endGroup() is called.
+	auto beginGroup() -> Handle {
+		Handle h = this->addNode(Kind::Group);
+		m_open.push_back(h);
+		return h;
+	}
+	auto endGroup() -> void {
+		assert(!m_open.empty());
+		Handle h = m_open.back();
+		m_open.pop_back();
+		m_subtreeEnd[h] = static_cast<uint32_t>(m_kind.size());
+		m_lineEnd[h]    = static_cast<uint32_t>(m_lines.size());
+		m_triEnd[h]     = static_cast<uint32_t>(m_triangles.size());
+	}
+	auto addLine(double x0, double y0, double x1, double y1) -> Handle {
+		Handle h = this->addNode(Kind::Line);
+		m_lines.x.insert(m_lines.x.end(), {x0, x1});
+		m_lines.y.insert(m_lines.y.end(), {y0, y1});
+		this->closeLeaf(h);
+		return h;
+	}
+	auto addTriangle(double x0, double y0, double x1, double y1, double x2, double y2) -> Handle {
+		Handle h = this->addNode(Kind::Triangle);
+		m_triangles.x.insert(m_triangles.x.end(), {x0, x1, x2});
+		m_triangles.y.insert(m_triangles.y.end(), {y0, y1, y2});
+		this->closeLeaf(h);
+		return h;
+	}
+
+	auto size()              const -> size_t { return m_kind.size(); }
+	auto kind(Handle h)      const -> Kind   { return m_kind[h]; }
+	auto parent(Handle h)    const -> Handle { return m_parent[h]; }
+	/// Number of nodes of the subtree, including the node itself
+	auto subtreeSize(Handle h) const -> size_t { return m_subtreeEnd[h] - h; }
+
+	/// Call function for each direct child of a group
+	template<typename Function>
+	auto forEachChild(Handle h, Function fn) const -> void {
+		for(Handle c = h + 1; c < m_subtreeEnd[h]; c = m_subtreeEnd[c])
+			fn(c);
+	}
+
+	/// Rotate all shapes of the subtree: one linear pass per shape type.
+	auto rotate(Handle h, double angle) -> void {
+		m_lines.rotate(m_lineBegin[h], m_lineEnd[h], angle);
+		m_triangles.rotate(m_triBegin[h], m_triEnd[h], angle);
+	}
+
+	auto checksum(Handle h) const -> double {
+		return m_lines.checksum(m_lineBegin[h], m_lineEnd[h])
+			+ m_triangles.checksum(m_triBegin[h], m_triEnd[h]);
+	}
+
+	auto draw(Handle h, std::ostream& os, int depth = 0) const -> void {
+		std::string indent(2 * depth + 1, ' ');
+		if(m_kind[h] == Kind::Group){
+			os << indent << "Group #" << h << " {\n";
+			this->forEachChild(h, [&](Handle c){ this->draw(c, os, depth + 1); });
+			os << indent << "}\n";
+			return;
+		}
+		const PointBatch& b = m_kind[h] == Kind::Line ? m_lines : m_triangles;
+		size_t first = (m_kind[h] == Kind::Line ? m_lineBegin[h] : m_triBegin[h]) * b.pointsPerShape;
+		os << indent << (m_kind[h] == Kind::Line ? "Line" : "Triangle") << " #" << h;
+		for(size_t i = first; i < first + b.pointsPerShape; i++)
+			os << " (" << b.x[i] << ", " << b.y[i] << ")";
+		os << "\n";
+	}
+
+private:
+	// Node arrays, indexed by handle
+	std::vector<Kind>     m_kind;
+	std::vector<Handle>   m_parent;
+	std::vector<uint32_t> m_subtreeEnd;
+	// Range of shapes of the subtree in each batch
+	std::vector<uint32_t> m_lineBegin, m_lineEnd;
+	std::vector<uint32_t> m_triBegin,  m_triEnd;
+	// Shape batches
+	PointBatch            m_lines;
+	PointBatch            m_triangles;
+	// Stack of open groups during construction
+	std::vector<Handle>   m_open;
+
+	auto addNode(Kind kind) -> Handle {
+		Handle h = static_cast<Handle>(m_kind.size());
+		m_kind.push_back(kind);
+		m_parent.push_back(m_open.empty() ? none : m_open.back());
+		m_subtreeEnd.push_back(h + 1);
+		m_lineBegin.push_back(static_cast<uint32_t>(m_lines.size()));
+		m_lineEnd.push_back(static_cast<uint32_t>(m_lines.size()));
+		m_triBegin.push_back(static_cast<uint32_t>(m_triangles.size()));
+		m_triEnd.push_back(static_cast<uint32_t>(m_triangles.size()));
+		return h;
+	}
+	auto closeLeaf(Handle h) -> void {
+		m_lineEnd[h] = static_cast<uint32_t>(m_lines.size());
+		m_triEnd[h]  = static_cast<uint32_t>(m_triangles.size());
+	}
+};
+
+constexpr Scene::Handle Scene::none;
+
+//======== Benchmark ============//
+
+template<typename Function>
+auto timeIt(Function fn) -> double {
+	auto t0 = std::chrono::steady_clock::now();
+	fn();
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+/// Compare deferred rotations of Group with rotations applied eagerly
+auto checkIncrementalUpdates() -> bool {
+	auto same = [](double a, double b){ return std::fabs(a - b) < 1e-9; };
+	bool ok = true;
+
+	// Node added after rotate() and before update()
+	{
+		Group root;
+		root.add(std::make_shared<Line>(1, 0, 2, 1));
+		root.rotate(0.5);
+		root.add(std::make_shared<Line>(3, 1, 0, 2));
+		root.update();
+		Line a(1, 0, 2, 1), b(3, 1, 0, 2);
+		a.rotate(0.5);
+		bool r = same(root.checksum(), a.checksum() + b.checksum());
+		std::cout << " Add after rotate()            => " << (r ? "OK" : "FAILED") << "\n";
+		ok = ok && r;
+	}
+	// Dirty subtree added to a clean group, then rotated again
+	{
+		Group root;
+		root.add(std::make_shared<Line>(1, 0, 2, 1));
+		root.update();
+		auto sub = std::make_shared<Group>();
+		sub->add(std::make_shared<Line>(3, 1, 0, 2));
+		sub->rotate(0.5);
+		root.add(sub);
+		root.update();
+		Line a(1, 0, 2, 1), b(3, 1, 0, 2);
+		b.rotate(0.5);
+		bool r1 = same(root.checksum(), a.checksum() + b.checksum());
+		sub->rotate(0.25);
+		root.update();
+		b.rotate(0.25);
+		bool r2 = same(root.checksum(), a.checksum() + b.checksum());
+		std::cout << " Add dirty subtree             => " << (r1 ? "OK" : "FAILED") << "\n";
+		std::cout << " Rotate subtree after adding   => " << (r2 ? "OK" : "FAILED") << "\n";
+		ok = ok && r1 && r2;
+	}
+	return ok;
+}
+
+int main(){
+	std::cout << "=== Incremental update of Group ===" << "\n";
+	if(!checkIncrementalUpdates())
+		return EXIT_FAILURE;
+
+	std::cout << "\n=== Small scene ===" << "\n";
+	Scene scene;
+	Scene::Handle root = scene.beginGroup();
+	scene.addTriangle(0, 0, 1, 0, 0, 1);
+	scene.addLine(0, 0, 2, 2);
+	Scene::Handle groupB = scene.beginGroup();
+	scene.addLine(1, 1, 3, 3);
+	scene.addTriangle(1, 1, 2, 1, 1, 2);
+	scene.endGroup();
+	scene.endGroup();
+	std::cout << std::fixed << std::setprecision(3);
+	scene.draw(root, std::cout);
+	std::cout << " [*] ==> Rotate group B by 90 degrees" << "\n";
+	scene.rotate(groupB, M_PI / 2);
+	scene.draw(root, std::cout);
+
+	// Hierarchy of 1000 groups with 1000 shapes each: ~1M nodes
+	const size_t ngroups = 1000, nshapes = 1000;
+	std::cout << "\n=== Benchmark: rotate scene with "
+			  << ngroups * (nshapes + 1) + 1 << " nodes ===" << "\n";
+
+	Group tree;
+	std::vector<std::shared_ptr<Group>> groups;
+	Scene flat;
+	double tBuildTree = timeIt([&]{
+		for(size_t g = 0; g < ngroups; g++){
+			auto group = std::make_shared<Group>();
+			for(size_t k = 0; k < nshapes; k++){
+				double a = g + 0.001 * k;
+				if(k % 2 == 0)
+					group->add(std::make_shared<Line>(a, 1, 2, a));
+				else
+					group->add(std::make_shared<Triangle>(a, 0, 1, a, 0, 1));
+			}
+			tree.add(group);
+			groups.push_back(group);
+		}
+	});
+	double tBuildFlat = timeIt([&]{
+		flat.beginGroup();
+		for(size_t g = 0; g < ngroups; g++){
+			flat.beginGroup();
+			for(size_t k = 0; k < nshapes; k++){
+				double a = g + 0.001 * k;
+				if(k % 2 == 0)
+					flat.addLine(a, 1, 2, a);
+				else
+					flat.addTriangle(a, 0, 1, a, 0, 1);
+			}
+			flat.endGroup();
+		}
+		flat.endGroup();
+	});
+
+	const int iterations = 10;
+	double tRotateTree = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			tree.rotate(0.1);
+			tree.update();
+		}
+	});
+	double tRotateFlat = timeIt([&]{
+		for(int i = 0; i < iterations; i++) flat.rotate(0, 0.1);
+	});
+
+	std::cout << " Build  - shared_ptr<IGraphic> tree = " << tBuildTree << " ms" << "\n";
+	std::cout << " Build  - flat Scene                = " << tBuildFlat << " ms" << "\n";
+	std::cout << " Rotate - shared_ptr<IGraphic> tree = " << tRotateTree / iterations << " ms" << "\n";
+	std::cout << " Rotate - flat Scene                = " << tRotateFlat / iterations << " ms" << "\n";
+	std::cout << " Speedup = " << tRotateTree / tRotateFlat << "x" << "\n";
+	std::cout << " Checksum tree = " << tree.checksum() << " ; flat = " << flat.checksum(0) << "\n";
+
+	std::cout << "\n=== Benchmark: incremental and parallel update of Group ===" << "\n";
+	WorkStealingPool pool;
+	double tParallel = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			tree.rotate(-0.1);
+			tree.update(&pool);
+		}
+	});
+	// Only the dirty subtree and the path to the root are visited
+	double tSubtree = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			groups[ngroups / 2]->rotate(0.1);
+			groups[ngroups / 3]->rotate(0.1);
+			tree.update(&pool);
+		}
+	});
+	// Nothing changed: update() returns immediately
+	double tClean = timeIt([&]{
+		for(int i = 0; i < iterations; i++) tree.update(&pool);
+	});
+	for(int i = 0; i < iterations; i++){
+		flat.rotate(0, -0.1);
+		flat.rotate(1 + (ngroups / 2) * (nshapes + 1), 0.1);
+		flat.rotate(1 + (ngroups / 3) * (nshapes + 1), 0.1);
+	}
+	std::cout << " Update whole tree - serial   = " << tRotateTree / iterations << " ms" << "\n";
+	std::cout << " Update whole tree - parallel = " << tParallel / iterations
+			  << " ms (" << pool.size() << " threads)" << "\n";
+	std::cout << " Update two dirty subtrees    = " << tSubtree / iterations << " ms" << "\n";
+	std::cout << " Update clean tree            = " << tClean / iterations << " ms" << "\n";
+	std::cout << " Checksum tree = " << tree.checksum() << " ; flat = " << flat.checksum(0) << "\n";
+
+	return 0;
+}
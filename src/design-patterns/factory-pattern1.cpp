@@ -1,12 +1,22 @@
 // File:   factory-pattern1.cpp 
 // Brief:  Factory design pattern with self registering of derived classes.
 // Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ factory-pattern1.cpp -o factory-pattern1.bin -std=c++1z -O2 -Wall
 //=======================================================================
 
 #include <iostream>
 #include <string>
 #include <map>
 #include <memory>
+#include <vector>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <chrono>
+
+#include "perfect-hash.hpp"
 
 // Macro for class registration 
 #define REGISER_FACTORY(derivedClass) \
@@ -21,20 +31,41 @@ class DerivedB;
 
 class Factory{
 private:
-	using FactoryMap = std::map<std::string, Factory*>;
+	using FactoryMap = std::map<std::string, Factory*, std::less<>>;
 	// Force global variable to be initialized, thus it avoid
 	// the inialization order fisaco. 
 	static auto getRegister() -> FactoryMap& {
 		static FactoryMap classRegister{};
 		return classRegister;
 	}
+	// Read-only copy of the register used for lookups after freeze()
+	static auto getFrozen() -> PerfectHashMap<Factory*>& {
+		static PerfectHashMap<Factory*> frozenRegister{};
+		return frozenRegister;
+	}
+	static auto isFrozen() -> bool& {
+		static bool frozen = false;
+		return frozen;
+	}
 public:	
 	/** Register factory object of derived class */
 	static
 	auto registerFactory(const std::string& name, Factory* factory) -> void {
+		if(Factory::isFrozen())
+			throw std::logic_error("Factory is frozen, cannot register class " + name);
 		auto& reg = Factory::getRegister();
 		reg[name] = factory;
 	}
+	/** Build a perfect hash table from the register, making lookups by
+	 *  name cost a few nanoseconds. It should be called once at startup,
+	 *  after all static registrations and before any thread is created.
+	 *  No class can be registered afterwards. */
+	static
+	auto freeze() -> void {
+		auto& reg = Factory::getRegister();
+		Factory::getFrozen() = PerfectHashMap<Factory*>(reg.begin(), reg.end());
+		Factory::isFrozen() = true;
+	}
 	/** Show all registered classes */
 	static
 	auto showClasses() -> void {
@@ -43,10 +74,19 @@ public:
 		for(const auto& pair: Factory::getRegister())
 			std::cout << " + " << pair.first << "\n";
 	}		
-	/**  Construct derived class returning a raw pointer */
+	/**  Construct derived class returning a raw pointer.
+	 *   Note: The hash of a key bound to a constexpr variable is computed
+	 *   at compile time:
+	 *     constexpr HashedKey keyA = "DerivedA"_key;  makeRaw(keyA);
+	 *   For makeRaw("DerivedA"_key) it is only folded if the optimizer
+	 *   does so. */
 	static
-	auto makeRaw(const std::string& name) -> Base* {
-		auto it = Factory::getRegister().find(name);
+	auto makeRaw(const HashedKey& name) -> Base* {
+		if(Factory::isFrozen()){
+			Factory* const* factory = Factory::getFrozen().find(name);
+			return factory != nullptr ? (*factory)->construct() : nullptr;
+		}
+		auto it = Factory::getRegister().find(name.name());
 		if(it != Factory::getRegister().end())
 			return it->second->construct();
 		return nullptr;
@@ -54,7 +94,7 @@ public:
 	
     /** Construct derived class returning an unique ptr  */
 	static
-	auto makeUnique(const std::string& name) -> std::unique_ptr<Base>{
+	auto makeUnique(const HashedKey& name) -> std::unique_ptr<Base>{
 		return std::unique_ptr<Base>(Factory::makeRaw(name));
 	}
 
@@ -124,6 +164,21 @@ public:
 
 REGISER_FACTORY(DerivedB);
 
+// Many product classes for the benchmark
+template<size_t N>
+class Generated: public Base{
+public:
+	auto getType() const -> std::string {
+		return "Generated" + std::to_string(N);
+	}
+};
+
+template<size_t... N>
+auto registerGenerated(std::index_sequence<N...>) -> void {
+	// Factories live until the end of the program
+	(new ConcreteFactory<Generated<N>>("Generated" + std::to_string(N)), ...);
+}
+
 // Disadvantage: Adding new derived classes to this function requires code modification
 auto simpleFactory(const std::string& name) -> std::unique_ptr<Base> {
 	if(name == "Base")
@@ -151,6 +206,42 @@ int main(){
 	std::unique_ptr<Base> objDC = Factory::makeUnique("Derived-error");
 	if(!objDC)
 		std::cout << " ==> Error: object not found in factory" << '\n';
+
+	std::cout << "\n ====== Benchmark - lookup in std::map vs perfect hash =====" << "\n";
+	registerGenerated(std::make_index_sequence<32>());
+	std::vector<std::string> names;
+	for(int i = 0; i < 32; i++)
+		names.push_back("Generated" + std::to_string(i));
+	names.push_back("DerivedA");
+	names.push_back("DerivedB");
+
+	const int n = 2000000;
+	size_t checksum = 0;
+	auto bench = [&](const char* label, auto makeObject){
+		auto t0 = std::chrono::steady_clock::now();
+		for(int i = 0; i < n; i++){
+			std::unique_ptr<Base> obj = makeObject(i);
+			checksum += obj != nullptr;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		std::cout << " " << label << " = "
+				  << std::chrono::duration<double, std::nano>(t1 - t0).count() / n
+				  << " ns/object" << "\n";
+	};
+	bench("std::map                     ", [&](int i){ return Factory::makeUnique(names[i % names.size()]); });
+	Factory::freeze();
+	bench("Perfect hash                 ", [&](int i){ return Factory::makeUnique(names[i % names.size()]); });
+	// Hash computed at compile time
+	static constexpr HashedKey keyA = "DerivedA"_key;
+	bench("Perfect hash (constexpr key) ", [&](int){ return Factory::makeUnique(keyA); });
+	bench("new DerivedA (no lookup)     ", [&](int){ return std::unique_ptr<Base>(new DerivedA); });
+	std::cout << " Objects created = " << checksum << "\n";
+
+	try {
+		Factory::registerFactory("Late", nullptr);
+	} catch(const std::logic_error& ex) {
+		std::cout << " ==> Expected error: " << ex.what() << "\n";
+	}
 	
 	return 0;
 }
@@ -3,6 +3,9 @@
 // Brief:  Universal Object Factory which can instantiate objects of any type.
 // Note:   The benefit of this implementation is that object doesn't need to have
 //         the same base class and the factory has no knowledge about any base class.
+//
+// Compile with:
+//  $ g++ factory-universal1.cpp -o factory-universal1.bin -std=c++1z -O2 -Wall
 //----------------------------------------------------------------------------------------------
 
 #include <iostream>
@@ -10,6 +13,10 @@
 #include <sstream>
 #include <map>
 #include <memory>
+#include <functional>
+#include <chrono>
+
+#include "perfect-hash.hpp"
 
 #define RUNTIME_ERROR_LOCATION(message)  \
 	runtime_error_location(__LINE__, __FILE__, message)
@@ -45,13 +52,31 @@ struct runtime_error_location: public std::exception {
 
 class UniversalFactory{
 private:
-	using FactoryMap = std::map<std::string, UniversalFactory*>;
+	using FactoryMap = std::map<std::string, UniversalFactory*, std::less<>>;
 	// Force global variable to be initialized, thus it avoid
 	// the inialization order fisaco.
 	static auto getRegister() -> FactoryMap& {
 		static FactoryMap classRegister{};
 		return classRegister;
 	}
+	// Read-only copy of the register used for lookups after freeze()
+	static auto getFrozen() -> PerfectHashMap<UniversalFactory*>& {
+		static PerfectHashMap<UniversalFactory*> frozenRegister{};
+		return frozenRegister;
+	}
+	static auto isFrozen() -> bool& {
+		static bool frozen = false;
+		return frozen;
+	}
+	static auto find(const HashedKey& name) -> UniversalFactory* {
+		if(UniversalFactory::isFrozen()){
+			UniversalFactory* const* factory = UniversalFactory::getFrozen().find(name);
+			return factory != nullptr ? *factory : nullptr;
+		}
+		FactoryMap& reg = UniversalFactory::getRegister();
+		auto it = reg.find(name.name());
+		return it != reg.end() ? it->second : nullptr;
+	}
 public:
       	// ========== Instance Methods ========//
 
@@ -79,9 +104,20 @@ public:
 	/** Register factory object of derived class */
 	static
 	auto registerFactory(const std::string& name, UniversalFactory* factory) -> void {
+		if(UniversalFactory::isFrozen())
+			throw RUNTIME_ERROR_LOCATION("Factory is frozen, cannot register class " + name);
 		auto& reg = UniversalFactory::getRegister();
 		reg[name] = factory;
 	}
+	/** Replace the register by a perfect hash table for faster lookups.
+	 *  Call once at startup, after all static registrations and before
+	 *  creating threads. Registering classes afterwards is an error. */
+	static
+	auto freeze() -> void {
+		auto& reg = UniversalFactory::getRegister();
+		UniversalFactory::getFrozen() = PerfectHashMap<UniversalFactory*>(reg.begin(), reg.end());
+		UniversalFactory::isFrozen() = true;
+	}
 	/** Show all registered classes printing their name to stdout. */
 	static
 	auto showClasses() -> void {
@@ -99,28 +135,27 @@ public:
 	/** Attemp to instantiate a class, if it is not possible, returns nullptr */
 	template<class BaseClass>
 	static
-	auto make(const std::string& name) -> std::unique_ptr<BaseClass> {
-		FactoryMap& reg = UniversalFactory::getRegister();
-		auto it = reg.find(name);
-		if(it == reg.end())
+	auto make(const HashedKey& name) -> std::unique_ptr<BaseClass> {
+		UniversalFactory* factory = UniversalFactory::find(name);
+		if(factory == nullptr)
 			return nullptr;
 		// Avoid core dump if the conversion is not possible.
-		if(it->second->typeinfo() != typeid(BaseClass))
+		if(factory->typeinfo() != typeid(BaseClass))
 			return nullptr;
-		void* ptr = it->second->create();
+		void* ptr = factory->create();
 		return std::unique_ptr<BaseClass>(reinterpret_cast<BaseClass*>(ptr));
 	}
 
     /** Attempt to instantiate class, if it is not possible throws an exception. */
 	template<class BaseClass>
 	static
-	auto makeSafe(const std::string& name) -> std::unique_ptr<BaseClass> {
+	auto makeSafe(const HashedKey& name) -> std::unique_ptr<BaseClass> {
 		// Throw exception for providing better context information and avoid
 		// Core dump due to dangerous reinterpret_cast<>.
 		auto object = UniversalFactory::make<BaseClass>(name);
 		if(object == nullptr)
 			throw RUNTIME_ERROR_LOCATION(
-				std::string("Cannot create type. Failed to cast void* to: ") + name	);
+				std::string("Cannot create type. Failed to cast void* to: ") + std::string(name.name()));
 		return object;
 	}
 };  // -------- End Of class UniversalFactory() ------//
@@ -240,5 +275,32 @@ int main(){
 		std::cerr << " [ERROR] " << ex.what() << "\n";
 	}
 
+	std::cout << "------- Test 5 - Frozen register (perfect hash) ------------" << "\n";
+	{
+		const int n = 2000000;
+		const std::string names[] = {"Base", "DerivedA", "DerivedB"};
+		auto bench = [&]{
+			size_t count = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			for(int i = 0; i < n; i++)
+				count += UniversalFactory::make<Base>(names[i % 3]) != nullptr;
+			auto t1 = std::chrono::steady_clock::now();
+			std::cout << " " << std::chrono::duration<double, std::nano>(t1 - t0).count() / n
+					  << " ns/object (created = " << count << ")" << "\n";
+		};
+		std::cout << " std::map register      = ";
+		bench();
+		UniversalFactory::freeze();
+		std::cout << " Perfect hash register  = ";
+		bench();
+		auto obj = UniversalFactory::makeSafe<Base>("DerivedB"_key);
+		obj->showType();
+		try {
+			UniversalFactory::registerFactory("Late", nullptr);
+		} catch(const runtime_error_location& ex){
+			std::cerr << " [ERROR] " << ex.what() << "\n";
+		}
+	}
+
 	return 0;
 }
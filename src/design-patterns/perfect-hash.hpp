@@ -0,0 +1,177 @@
+// File:   perfect-hash.hpp
+// Brief:  Read-only string-keyed map based on minimal perfect hashing.
+// Author: Caio Rodrigues
+//
+//  + HashedKey - string key with its 64-bit FNV-1a hash. The constructor is
+//    constexpr, so the hash of a key bound to a constexpr variable is
+//    computed at compile time:
+//      constexpr HashedKey key = "DerivedA";   or   = "DerivedA"_key;
+//    A literal passed directly, find("DerivedA"_key), is evaluated at run
+//    time unless the optimizer folds it.
+//
+//  + PerfectHashMap<Value> - built once from a set of distinct keys, then
+//    immutable. Uses hash and displace: keys are split into buckets and,
+//    for each bucket, a seed is searched which sends all its keys to free
+//    slots. Then every key has its own slot and a table of n slots holds n
+//    keys (minimal perfect hash). A lookup costs one string hash, which is
+//    skipped for precomputed keys, two table reads and one key comparison.
+//-------------------------------------------------------------------------
+#ifndef _PERFECT_HASH_HPP_
+#define _PERFECT_HASH_HPP_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+class HashedKey{
+public:
+	constexpr HashedKey(std::string_view name)
+		: m_name(name), m_hash(fnv1a(name)) { }
+	constexpr HashedKey(const char* name)
+		: HashedKey(std::string_view(name)) { }
+	HashedKey(const std::string& name)
+		: HashedKey(std::string_view(name)) { }
+
+	constexpr auto name() const -> std::string_view { return m_name; }
+	constexpr auto hash() const -> uint64_t { return m_hash; }
+
+	static constexpr auto fnv1a(std::string_view s) -> uint64_t {
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for(char c: s){
+			h ^= static_cast<unsigned char>(c);
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+private:
+	std::string_view m_name;
+	uint64_t         m_hash;
+};
+
+constexpr auto operator""_key(const char* name, size_t size) -> HashedKey {
+	return HashedKey(std::string_view(name, size));
+}
+
+template<typename Value>
+class PerfectHashMap{
+public:
+	PerfectHashMap() = default;
+
+	/// Build from range of pairs (key, value). Keys must be distinct,
+	/// otherwise std::invalid_argument is thrown.
+	template<typename Iterator>
+	PerfectHashMap(Iterator first, Iterator last){
+		for(; first != last; ++first)
+			m_entries.push_back(Entry{std::string(first->first), first->second, 0});
+		this->build();
+	}
+
+	/// Returns nullptr if the key is not in the map.
+	auto find(const HashedKey& key) const -> const Value* {
+		if(m_entries.empty())
+			return nullptr;
+		uint64_t h   = key.hash();
+		uint32_t d   = m_seeds[bucketOf(h)];
+		const Entry& e = m_entries[slotOf(h, d)];
+		if(e.hash != h || e.key != key.name())
+			return nullptr;
+		return &e.value;
+	}
+	auto size()  const -> size_t { return m_entries.size(); }
+	auto empty() const -> bool   { return m_entries.empty(); }
+
+private:
+	struct Entry{
+		std::string key;
+		Value       value;
+		uint64_t    hash;
+	};
+	// Entries in slot order
+	std::vector<Entry>    m_entries;
+	// Displacement seed of each bucket
+	std::vector<uint32_t> m_seeds;
+
+	auto bucketOf(uint64_t h) const -> size_t {
+		return (h >> 32) % m_seeds.size();
+	}
+	auto slotOf(uint64_t h, uint32_t seed) const -> size_t {
+		// splitmix64 finalizer, spreads the seeded hash over all bits
+		uint64_t z = h + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return (z ^ (z >> 31)) % m_entries.size();
+	}
+
+	auto build() -> void {
+		const size_t n = m_entries.size();
+		if(n == 0)
+			return;
+		for(auto& e: m_entries)
+			e.hash = HashedKey::fnv1a(e.key);
+		{
+			std::vector<std::pair<uint64_t, std::string_view>> keys;
+			for(const auto& e: m_entries)
+				keys.emplace_back(e.hash, e.key);
+			std::sort(keys.begin(), keys.end());
+			for(size_t i = 1; i < n; i++)
+				if(keys[i].first == keys[i - 1].first)
+					throw std::invalid_argument(keys[i].second == keys[i - 1].second
+						? "PerfectHashMap: duplicate key " + std::string(keys[i].second)
+						: "PerfectHashMap: hash collision between keys " + std::string(keys[i].second)
+						  + " and " + std::string(keys[i - 1].second));
+		}
+		// About two keys per bucket
+		m_seeds.assign(n / 2 + 1, 0);
+		std::vector<std::vector<size_t>> buckets(m_seeds.size());
+		for(size_t i = 0; i < n; i++)
+			buckets[bucketOf(m_entries[i].hash)].push_back(i);
+		std::vector<size_t> order(buckets.size());
+		for(size_t b = 0; b < order.size(); b++)
+			order[b] = b;
+		// Larger buckets are placed first, while most slots are free
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+			return buckets[a].size() > buckets[b].size();
+		});
+
+		std::vector<size_t> slotOfEntry(n);
+		std::vector<bool>   used(n, false);
+		std::vector<size_t> slots;
+		for(size_t b: order){
+			if(buckets[b].empty())
+				break;
+			for(uint32_t seed = 0; ; seed++){
+				if(seed == UINT32_MAX)
+					throw std::runtime_error("PerfectHashMap: cannot find perfect hash");
+				slots.clear();
+				bool ok = true;
+				for(size_t i: buckets[b]){
+					size_t s = slotOf(m_entries[i].hash, seed);
+					if(used[s] || std::find(slots.begin(), slots.end(), s) != slots.end()){
+						ok = false;
+						break;
+					}
+					slots.push_back(s);
+				}
+				if(!ok)
+					continue;
+				m_seeds[b] = seed;
+				for(size_t k = 0; k < slots.size(); k++){
+					used[slots[k]] = true;
+					slotOfEntry[buckets[b][k]] = slots[k];
+				}
+				break;
+			}
+		}
+		// Move entries to their slots
+		std::vector<Entry> table(n);
+		for(size_t i = 0; i < n; i++)
+			table[slotOfEntry[i]] = std::move(m_entries[i]);
+		m_entries = std::move(table);
+	}
+};
+
+#endif
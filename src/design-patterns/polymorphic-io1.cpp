@@ -1,6 +1,9 @@
 // File:   polymorphic-io1.cpp 
 // Brief:  Demonstration about how to write polymorphic IO code or I/O agnostic code.
 // Author: Caio Rodrigues
+//
+// Compile with (requires C++20 for std::span):
+//  $ g++ polymorphic-io1.cpp -o polymorphic-io1.bin -std=c++2a -O2 -Wall -Wextra
 //-------------------------------------------------------------------------------------
 
 #include <iostream>
@@ -11,6 +14,22 @@
 #include <vector>
 #include <iomanip>
 #include <string>
+#include <string_view>
+#include <stdexcept>
+#include <charconv>
+#include <span>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+
+// Unix specific (memory mapped files)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace VectorIO{
 	/** Write vector of doubles to any output stream. */
@@ -21,6 +40,47 @@ namespace VectorIO{
 	/** Read vector of doubles from any input stream. */
 	auto readVector(std::istream& is) -> std::vector<double>;
 	auto readVector(std::istream&& is) -> std::vector<double>;
+
+	/** Binary format: header followed by the elements as IEEE754 doubles
+	 *  in little-endian byte order. The checksum is computed over the
+	 *  elements and verified by the readers.
+	 */
+	struct BinaryHeader{
+		char     magic[4] = {'V', 'E', 'C', 'B'};
+		uint32_t version  = 1;
+		uint64_t count    = 0;
+		uint64_t checksum = 0;
+	};
+	static_assert(sizeof(BinaryHeader) == 24, "Header must not have padding");
+	static_assert(std::endian::native == std::endian::little,
+				  "Binary format assumes a little-endian host");
+
+	/** FNV-1a variant which processes 64 bits words. */
+	auto checksum(std::span<const double> xs) -> uint64_t;
+
+	/** Write header and elements with a single bulk write. */
+	auto writeVectorBinary(std::ostream& os, std::span<const double> xs) -> void;
+	/** Read vector written by writeVectorBinary with a single bulk read. */
+	auto readVectorBinary(std::istream& is) -> std::vector<double>;
+
+	/** Memory mapped file in the binary format. The elements are
+	 *  accessed directly from the page cache, without copying.
+	 *  Throws std::runtime_error if the file is invalid.
+	 */
+	class MappedVector{
+	public:
+		explicit MappedVector(const std::string& path, bool verifyChecksum = true);
+		~MappedVector();
+		MappedVector(MappedVector&& rhs) noexcept;
+		MappedVector(const MappedVector&) = delete;
+		MappedVector& operator=(const MappedVector&) = delete;
+		/// View of the elements, valid while this object is alive.
+		auto view() const -> std::span<const double> { return m_view; }
+	private:
+		void*                   m_addr = nullptr;
+		size_t                  m_size = 0;
+		std::span<const double> m_view;
+	};
 }
 
 int main(){
@@ -58,17 +118,92 @@ int main(){
 	// Call L-value reference version of readVector 
 	auto out3 = readVector(fd);
 	writeVector(std::cout, out3);	
+
+	std::cout << "\n TEST8 Binary format - write to file and memory map it" << "\n";
+	{
+		std::ofstream bfile("vector.bin", std::ios::binary);
+		VectorIO::writeVectorBinary(bfile, vtest);
+	}
+	auto mapped = VectorIO::MappedVector("vector.bin");
+	for(double x: mapped.view())
+		std::cout << x << " ";
+	std::cout << "\n";
+
+	std::cout << "\n TEST9 Benchmark" << "\n";
+	using clock = std::chrono::steady_clock;
+	auto ms = [](auto d){ return std::chrono::duration<double, std::milli>(d).count(); };
+	std::vector<double> big(5000000);
+	for(size_t i = 0; i < big.size(); i++)
+		big[i] = i * 0.001 + 1.0 / (i + 1);
+
+	auto t0 = clock::now();
+	{
+		// Former text path: one operator<< per element
+		std::ofstream f("bench-iostream.txt");
+		f << "VECTOR ";
+		for(double x: big) f << x << " ";
+	}
+	auto t1 = clock::now();
+	writeVector(std::ofstream("bench-chars.txt"), big);
+	auto t2 = clock::now();
+	{
+		std::ofstream f("bench.bin", std::ios::binary);
+		VectorIO::writeVectorBinary(f, big);
+	}
+	auto t3 = clock::now();
+	size_t nIostream = 0;
+	{
+		std::ifstream f("bench-iostream.txt");
+		std::string label;
+		f >> label;
+		double x;
+		while(f >> x) nIostream++;
+	}
+	auto t4 = clock::now();
+	auto fromChars = readVector(std::ifstream("bench-chars.txt"));
+	auto t5 = clock::now();
+	std::ifstream binFile("bench.bin", std::ios::binary);
+	auto fromBinary = VectorIO::readVectorBinary(binFile);
+	auto t6 = clock::now();
+	auto mappedBig = VectorIO::MappedVector("bench.bin");
+	auto t7 = clock::now();
+
+	std::cout << " Elements = " << big.size() << "\n";
+	std::cout << " Write text (operator<<)     = " << ms(t1 - t0) << " ms" << "\n";
+	std::cout << " Write text (to_chars)       = " << ms(t2 - t1) << " ms" << "\n";
+	std::cout << " Write binary                = " << ms(t3 - t2) << " ms" << "\n";
+	std::cout << " Read text (operator>>)      = " << ms(t4 - t3) << " ms ; n = " << nIostream << "\n";
+	std::cout << " Read text (from_chars)      = " << ms(t5 - t4) << " ms ; exact = "
+			  << std::boolalpha << (fromChars == big) << "\n";
+	std::cout << " Read binary                 = " << ms(t6 - t5) << " ms ; exact = "
+			  << (fromBinary == big) << "\n";
+	std::cout << " Memory map (with checksum)  = " << ms(t7 - t6) << " ms ; n = "
+			  << mappedBig.view().size() << "\n";
+	for(auto file: {"bench-iostream.txt", "bench-chars.txt", "bench.bin"})
+		std::remove(file);
 }
 
 namespace VectorIO{
 	auto writeVector(std::ostream& os, const std::vector<double>& xs) -> void
 	{
+		// Format numbers with std::to_chars (shortest representation which
+		// round-trips) into a buffer written in large chunks.
+		char buffer[16384];
+		const size_t maxChars = 32;
+		size_t n = 0;
 		os << "VECTOR";
 		os << " ";
-		for(auto x: xs)
-			os << x << " ";
+		for(auto x: xs){
+			if(n + maxChars > sizeof(buffer)){
+				os.write(buffer, n);
+				n = 0;
+			}
+			auto res = std::to_chars(buffer + n, buffer + sizeof(buffer), x);
+			n = res.ptr - buffer;
+			buffer[n++] = ' ';
+		}
+		os.write(buffer, n);
 		os << "\n";
-		os.flush();
 	}
 	auto writeVector(std::ostream&& os, const std::vector<double>& xs) -> void
 	{
@@ -82,10 +217,23 @@ namespace VectorIO{
 		is >> label;
 		if(label != "VECTOR")
 			throw std::runtime_error("Error: wrong file layout.");
-		double x;
-		while(is.good() && !is.eof()){
-			is >> x;
+		// Parse the remaining content with std::from_chars
+		std::stringstream content;
+		content << is.rdbuf();
+		const std::string text = content.str();
+		const char* p   = text.data();
+		const char* end = p + text.size();
+		for(;;){
+			while(p != end && std::isspace(static_cast<unsigned char>(*p)))
+				p++;
+			if(p == end)
+				break;
+			double x;
+			auto res = std::from_chars(p, end, x);
+			if(res.ec != std::errc())
+				throw std::runtime_error("Error: invalid number.");
 			xlist.push_back(x);
+			p = res.ptr;
 		}
 		return xlist;
 	}
@@ -94,4 +242,91 @@ namespace VectorIO{
 		std::cerr << " [LOG] (readVector) R-value reference" << "\n";
 		return readVector(is);
 	}
+
+	auto checksum(std::span<const double> xs) -> uint64_t
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for(double x: xs){
+			hash ^= std::bit_cast<uint64_t>(x);
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+	auto writeVectorBinary(std::ostream& os, std::span<const double> xs) -> void
+	{
+		BinaryHeader header;
+		header.count    = xs.size();
+		header.checksum = checksum(xs);
+		os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		os.write(reinterpret_cast<const char*>(xs.data()), xs.size_bytes());
+		if(!os)
+			throw std::runtime_error("Error: failed to write vector.");
+	}
+	auto readVectorBinary(std::istream& is) -> std::vector<double>
+	{
+		BinaryHeader header;
+		if(!is.read(reinterpret_cast<char*>(&header), sizeof(header))
+		   || std::memcmp(header.magic, "VECB", 4) != 0 || header.version != 1)
+			throw std::runtime_error("Error: wrong file layout.");
+		std::vector<double> xs;
+		// Grow in bounded steps, so that a corrupted count cannot
+		// allocate a huge buffer before the read fails.
+		const size_t step = 1 << 20;
+		while(xs.size() < header.count){
+			size_t k = std::min<size_t>(step, header.count - xs.size());
+			size_t old = xs.size();
+			xs.resize(old + k);
+			if(!is.read(reinterpret_cast<char*>(xs.data() + old), k * sizeof(double)))
+				throw std::runtime_error("Error: unexpected end of file.");
+		}
+		if(checksum(xs) != header.checksum)
+			throw std::runtime_error("Error: checksum mismatch.");
+		return xs;
+	}
+
+	MappedVector::MappedVector(const std::string& path, bool verifyChecksum)
+	{
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			throw std::runtime_error("Error: cannot open file " + path);
+		struct stat st;
+		if(::fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(BinaryHeader)){
+			::close(fd);
+			throw std::runtime_error("Error: wrong file layout.");
+		}
+		m_size = st.st_size;
+		m_addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping remains valid after the file descriptor is closed
+		::close(fd);
+		if(m_addr == MAP_FAILED){
+			m_addr = nullptr;
+			throw std::runtime_error("Error: mmap failed for " + path);
+		}
+		BinaryHeader header;
+		std::memcpy(&header, m_addr, sizeof(header));
+		size_t available = (m_size - sizeof(header)) / sizeof(double);
+		if(std::memcmp(header.magic, "VECB", 4) != 0 || header.version != 1
+		   || header.count > available){
+			::munmap(m_addr, m_size);
+			throw std::runtime_error("Error: wrong file layout.");
+		}
+		// The header is 24 bytes, so the elements are 8-byte aligned
+		auto data = reinterpret_cast<const double*>(static_cast<const char*>(m_addr) + sizeof(header));
+		m_view = std::span<const double>(data, header.count);
+		if(verifyChecksum && checksum(m_view) != header.checksum){
+			::munmap(m_addr, m_size);
+			throw std::runtime_error("Error: checksum mismatch.");
+		}
+	}
+	MappedVector::MappedVector(MappedVector&& rhs) noexcept
+		: m_addr(rhs.m_addr), m_size(rhs.m_size), m_view(rhs.m_view)
+	{
+		rhs.m_addr = nullptr;
+		rhs.m_view = {};
+	}
+	MappedVector::~MappedVector()
+	{
+		if(m_addr != nullptr)
+			::munmap(m_addr, m_size);
+	}
 }
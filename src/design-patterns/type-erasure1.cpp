@@ -2,11 +2,21 @@
 // Brief:     Basic type erasure implementation example.
 // Objective: Demonstrate how type erasure works.
 // Author:    Caio Rodrigues
+//
+// Compile with:
+//  $ clang++ type-erasure1.cpp -o type-erasure1.bin -std=c++1z -O2 -Wall -Wextra
 //-------------------------------------------------------
 #include <iostream>
 #include <vector>
 #include <deque>
 #include <memory> // Smart pointers 
+#include <string>
+#include <typeinfo>
+#include <type_traits>
+#include <new>
+#include <cstddef>
+#include <stdexcept>
+#include <chrono>
 
 class TypeErasure{
 private:
@@ -71,6 +81,189 @@ private:
 };
 
 
+/** Type erasure with small buffer optimization (SBO).
+ *
+ *  Objects up to BufferSize bytes (with nothrow move constructor) are
+ *  stored inline, without heap allocation, larger objects are allocated
+ *  on the heap and the buffer holds the pointer.
+ *
+ *  Instead of a Concept base class with virtual methods, each wrapped type
+ *  has a static table of function pointers (hand-rolled vtable), so the
+ *  object is just the buffer plus a pointer to this table.
+ *
+ *  The policy selects whether the wrapper is copyable (requires copyable
+ *  wrapped types) or move-only (accepts move-only wrapped types).
+ */
+enum class ErasurePolicy { Copyable, MoveOnly };
+
+template<size_t BufferSize = 32, ErasurePolicy Policy = ErasurePolicy::Copyable>
+class SBOTypeErasure{
+private:
+	static constexpr size_t BufferAlign = alignof(std::max_align_t);
+	static_assert(BufferSize >= sizeof(void*), "Buffer must be able to hold a pointer");
+
+	// Hand-rolled virtual table, one static instance per wrapped type
+	struct VTable{
+		auto (* getName)(const void* obj) -> std::string;
+		auto (* copy)(void* dst, const void* src) -> void;
+		auto (* move)(void* dst, void* src) noexcept -> void;
+		auto (* destroy)(void* obj) noexcept -> void;
+		auto (* object)(const void* buffer) -> const void*;
+		const std::type_info& tinfo;
+	};
+
+	template<typename T>
+	static constexpr bool isInline =
+		sizeof(T) <= BufferSize && alignof(T) <= BufferAlign
+		&& std::is_nothrow_move_constructible<T>::value;
+
+	// Object stored in the buffer
+	template<typename T>
+	struct InlineStorage{
+		static auto get(const void* buf) -> const T* {
+			return std::launder(reinterpret_cast<const T*>(buf));
+		}
+		static auto copy(void* dst, const void* src) -> void {
+			new (dst) T(*get(src));
+		}
+		// The source is left in moved-from state and destroyed by its owner
+		static auto move(void* dst, void* src) noexcept -> void {
+			new (dst) T(std::move(*const_cast<T*>(get(src))));
+		}
+		static auto destroy(void* buf) noexcept -> void {
+			const_cast<T*>(get(buf))->~T();
+		}
+	};
+	// Buffer holds a pointer to the object allocated on the heap
+	template<typename T>
+	struct HeapStorage{
+		static auto get(const void* buf) -> const T* {
+			return *reinterpret_cast<T* const*>(buf);
+		}
+		static auto copy(void* dst, const void* src) -> void {
+			*reinterpret_cast<T**>(dst) = new T(*get(src));
+		}
+		static auto move(void* dst, void* src) noexcept -> void {
+			*reinterpret_cast<T**>(dst) = *reinterpret_cast<T**>(src);
+			*reinterpret_cast<T**>(src) = nullptr;
+		}
+		static auto destroy(void* buf) noexcept -> void {
+			delete get(buf);
+		}
+	};
+
+	template<typename T>
+	using Storage = std::conditional_t<isInline<T>, InlineStorage<T>, HeapStorage<T>>;
+
+	template<typename T>
+	static constexpr auto copyFunction() -> void (*)(void*, const void*) {
+		if constexpr(Policy == ErasurePolicy::Copyable)
+			return &Storage<T>::copy;
+		else
+			return nullptr;
+	}
+
+	template<typename T>
+	static auto vtableFor() -> const VTable* {
+		static const VTable table = {
+			[](const void* buf){ return Storage<T>::get(buf)->getName(); },
+			copyFunction<T>(),
+			&Storage<T>::move,
+			&Storage<T>::destroy,
+			[](const void* buf) -> const void* { return Storage<T>::get(buf); },
+			typeid(T)
+		};
+		return &table;
+	}
+
+	alignas(BufferAlign) unsigned char _buffer[BufferSize];
+	const VTable* _vtable;
+
+	// With the MoveOnly policy the copy constructor and copy assignment
+	// below take this unrelated type, so they are not copy operations and
+	// the implicit ones are deleted (a move constructor is declared).
+	// Thus std::is_copy_constructible is false and generic code (e.g.
+	// std::vector growth) takes the move path.
+	struct NotCopyable{ };
+	using CopySource = std::conditional_t<Policy == ErasurePolicy::Copyable,
+										  const SBOTypeErasure&, const NotCopyable&>;
+
+public:
+	template<typename T,
+			 typename = std::enable_if_t<!std::is_same<std::decay_t<T>, SBOTypeErasure>::value>>
+	SBOTypeErasure(T&& obj)
+		: _vtable(vtableFor<std::decay_t<T>>())
+	{
+		using U = std::decay_t<T>;
+		static_assert(Policy == ErasurePolicy::MoveOnly || std::is_copy_constructible<U>::value,
+					  "Copyable type erasure requires a copyable type");
+		if constexpr(isInline<U>)
+			new (_buffer) U(std::forward<T>(obj));
+		else
+			*reinterpret_cast<U**>(_buffer) = new U(std::forward<T>(obj));
+	}
+	SBOTypeErasure(CopySource rhs)
+		: _vtable(rhs._vtable)
+	{
+		_vtable->copy(_buffer, rhs._buffer);
+	}
+	SBOTypeErasure(SBOTypeErasure&& rhs) noexcept
+		: _vtable(rhs._vtable)
+	{
+		_vtable->move(_buffer, rhs._buffer);
+	}
+	// Copy into a temporary first, so *this is unchanged if the copy throws
+	auto operator=(CopySource rhs) -> SBOTypeErasure& {
+		if(this != &rhs){
+			SBOTypeErasure tmp(rhs);
+			*this = std::move(tmp);
+		}
+		return *this;
+	}
+	auto operator=(SBOTypeErasure&& rhs) noexcept -> SBOTypeErasure& {
+		if(this != &rhs){
+			_vtable->destroy(_buffer);
+			_vtable = rhs._vtable;
+			_vtable->move(_buffer, rhs._buffer);
+		}
+		return *this;
+	}
+	~SBOTypeErasure(){
+		_vtable->destroy(_buffer);
+	}
+
+	/// True if the object was moved out of this wrapper. Only a moved-from
+	/// wrapper holding a heap allocated object is empty; it can be assigned
+	/// or destroyed, other methods require !empty().
+	auto empty() const -> bool {
+		return _vtable->object(_buffer) == nullptr;
+	}
+	explicit operator bool() const { return !this->empty(); }
+
+	/// Precondition: !empty()
+	auto getName() const -> std::string {
+		return _vtable->getName(_buffer);
+	}
+
+	// Recover copy of wrapped type
+	template<typename T>
+	auto recover() const -> T {
+		if(typeid(T) != _vtable->tinfo)
+			throw std::runtime_error("Error: cannot cast to this type");
+		return *static_cast<const T*>(_vtable->object(_buffer));
+	}
+
+	template<typename T>
+	auto hasType() const -> bool {
+		return _vtable->tinfo == typeid(T);
+	}
+	// True if the object is stored in the inline buffer
+	template<typename T>
+	static constexpr auto fitsInline() -> bool {
+		return isInline<T>;
+	}
+};
+
 class A{
 public:
 	std::string getName() const {
@@ -101,6 +294,55 @@ public:
 	}
 };
 
+// Types used by the SBO experiments
+class Big{
+	double _data[16] = {};
+public:
+	std::string getName() const { return "class Big"; }
+};
+
+class Unique{
+	std::unique_ptr<int> _ptr;
+public:
+	Unique(int n): _ptr(std::make_unique<int>(n)) { }
+	std::string getName() const { return "class Unique = " + std::to_string(*_ptr); }
+};
+
+template<int N>
+class Small{
+	int _value;
+public:
+	Small(int value): _value(value) { }
+	std::string getName() const { return N == 0 ? "Small<0>" : N == 1 ? "Small<1>" : "Small<2>"; }
+};
+
+template<typename Container>
+auto benchmarkErasure(const char* label, size_t n) -> void {
+	using clock = std::chrono::steady_clock;
+	auto t0 = clock::now();
+	Container cont;
+	cont.reserve(n);
+	for(size_t i = 0; i < n; i++){
+		int v = static_cast<int>(i);
+		if(i % 3 == 0)      cont.emplace_back(Small<0>(v));
+		else if(i % 3 == 1) cont.emplace_back(Small<1>(v));
+		else                cont.emplace_back(Small<2>(v));
+	}
+	auto t1 = clock::now();
+	size_t total = 0;
+	for(const auto& t: cont)
+		total += t.getName().size();
+	auto t2 = clock::now();
+	cont.clear();
+	auto t3 = clock::now();
+	auto ms = [](auto d){ return std::chrono::duration<double, std::milli>(d).count(); };
+	std::cout << " " << label
+			  << " build = "    << ms(t1 - t0) << " ms"
+			  << " ; iterate = " << ms(t2 - t1) << " ms"
+			  << " ; destroy = " << ms(t3 - t2) << " ms"
+			  << " ; (checksum " << total << ")\n";
+}
+
 int main(){
 	auto tlist = std::deque<TypeErasure>();
 	tlist.emplace_back(A());
@@ -131,6 +373,44 @@ int main(){
 
 	 auto objC = tlist.at(2).recover<C>();
 	 objC.sayC();
+
+	 std::cout << "\n" << "EXPERIMENT 3 - Small buffer optimization ====" << "\n";
+	 using Erased = SBOTypeErasure<32>;
+	 auto slist = std::vector<Erased>();
+	 slist.emplace_back(A());
+	 slist.emplace_back(Big());
+	 slist.emplace_back(Small<1>(10));
+	 for(const auto& t: slist)
+		 std::cout << "Class type = " << t.getName() << "\n";
+	 std::cout << std::boolalpha
+			   << " Stored inline A = " << Erased::fitsInline<A>()
+			   << " ; Big = " << Erased::fitsInline<Big>() << "\n";
+	 Erased copy = slist.at(1);
+	 std::cout << " Copy has type Big = " << copy.hasType<Big>() << "\n";
+	 slist.at(0).recover<A>().sayA();
+
+	 // Move-only wrapper accepts move-only types
+	 static_assert(!std::is_copy_constructible<SBOTypeErasure<16, ErasurePolicy::MoveOnly>>::value
+				   && std::is_nothrow_move_constructible<SBOTypeErasure<16, ErasurePolicy::MoveOnly>>::value,
+				   "Move-only type erasure must only be movable");
+	 static_assert(std::is_copy_constructible<SBOTypeErasure<16>>::value, "Copyable type erasure");
+	 auto ulist = std::vector<SBOTypeErasure<16, ErasurePolicy::MoveOnly>>();
+	 ulist.emplace_back(Unique(100));
+	 ulist.emplace_back(C());
+	 auto moved = std::move(ulist);
+	 for(const auto& t: moved)
+		 std::cout << "Class type = " << t.getName() << "\n";
+
+	 // Heap allocated object: the moved-from wrapper is empty
+	 SBOTypeErasure<16> big1 = Big();
+	 SBOTypeErasure<16> big2 = std::move(big1);
+	 std::cout << std::boolalpha << " big1.empty() = " << big1.empty()
+			   << " ; big2 = " << big2.getName() << "\n";
+
+	 std::cout << "\n" << "EXPERIMENT 4 - Benchmark ====" << "\n";
+	 const size_t n = 3000000;
+	 benchmarkErasure<std::vector<TypeErasure>>("shared_ptr<Concept>:", n);
+	 benchmarkErasure<std::vector<SBOTypeErasure<16>>>("SBOTypeErasure<16>: ", n);
 	 
 	 return EXIT_SUCCESS;
 }
@@ -2,6 +2,9 @@
 // Brief:  Visitor design pattern for class instrospection.
 // Tags:   template metaprogramming reflection oop visitor design pattern 
 // Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ visitor-instrospection.cpp -o visitor-instrospection.bin -std=c++1z -O2 -Wall
 //---------------------------------------------------------------------------------
 
 #include <iostream>
@@ -12,6 +15,14 @@
 #include <istream>
 #include <fstream>
 #include <iomanip>
+#include <string_view>
+#include <type_traits>
+#include <stdexcept>
+#include <limits>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
 
 /** Print class information such as name and fields to stdout. */
 struct DescriptionVisitor{
@@ -139,6 +150,539 @@ struct DeserializeVisitor{
 
 };
 
+/** Portable binary wire format used by BinaryWriter and BinaryReader
+ *
+ *  + Signed integers:   zigzag encoded varint (LEB128)
+ *  + Unsigned integers: varint (LEB128)
+ *  + bool:              1 byte
+ *  + float, double:     IEEE754, 4 or 8 bytes little-endian
+ *  + strings:           varint length followed by the bytes
+ *
+ *  Records optionally start with the 8 bytes schema hash of the class.
+ */
+namespace wire{
+	// Type tag used by the schema hash, std::string and std::string_view
+	// have the same encoding and the same tag.
+	template<class T>
+	constexpr auto typeTag() -> char {
+		if constexpr(std::is_same_v<T, bool>)             return 'b';
+		else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>) return 'i';
+		else if constexpr(std::is_integral_v<T>)          return 'u';
+		else if constexpr(std::is_same_v<T, float>)       return 'f';
+		else if constexpr(std::is_same_v<T, double>)      return 'd';
+		else if constexpr(std::is_same_v<T, std::string>
+						  || std::is_same_v<T, std::string_view>) return 's';
+		else static_assert(sizeof(T) == 0, "Type not supported by the wire format");
+	}
+	inline auto zigzag(int64_t x) -> uint64_t {
+		return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+	}
+	inline auto unzigzag(uint64_t x) -> int64_t {
+		return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+	}
+	// Checked integer conversion of decoded values, throws std::runtime_error
+	template<class T, class U>
+	auto narrow(U x) -> T {
+		if constexpr(std::is_signed_v<U>){
+			if(x < std::numeric_limits<T>::min() || x > std::numeric_limits<T>::max())
+				throw std::runtime_error("Error: integer out of range");
+		} else {
+			if(x > std::numeric_limits<T>::max())
+				throw std::runtime_error("Error: integer out of range");
+		}
+		return static_cast<T>(x);
+	}
+}
+
+/** Compute 64 bits FNV-1a hash of the class name, field names and field types. */
+struct SchemaHashVisitor{
+	using cstring = const char*;
+	uint64_t hash = 14695981039346656037ULL;
+
+	template<class Described>
+	void visit(Described& desc){
+		desc.describe(*this);
+	}
+	template<class S>
+	void name(const S& className){
+		this->mix(className);
+	}
+	template<class T>
+	void field(T&, cstring name){
+		this->mix(name);
+		char tag = wire::typeTag<T>();
+		this->mix(std::string_view(&tag, 1));
+	}
+private:
+	void mix(std::string_view str){
+		for(char ch: str){
+			hash ^= static_cast<unsigned char>(ch);
+			hash *= 1099511628211ULL;
+		}
+		// Separator, so that ("ab", "c") and ("a", "bc") differ
+		hash ^= 0xFF;
+		hash *= 1099511628211ULL;
+	}
+};
+
+/** Schema hash of a describe()-enabled class, computed once per type. */
+template<class Described>
+auto schemaHash() -> uint64_t {
+	static const uint64_t hash = []{
+		Described obj{};
+		SchemaHashVisitor v;
+		v.visit(obj);
+		return v.hash;
+	}();
+	return hash;
+}
+
+/** Serialize class data to a contiguous growable buffer with the
+ *  portable wire format (see namespace wire). */
+class BinaryWriter{
+public:
+	using cstring = const char*;
+
+	explicit BinaryWriter(std::vector<uint8_t>& buffer): _buf(buffer) { }
+
+	template<class Described>
+	void visit(Described& desc){
+		desc.describe(*this);
+	}
+	/// Serialize record preceded by the schema hash
+	template<class Described>
+	void visitWithSchema(Described& desc){
+		this->writeFixed(schemaHash<Described>(), 8);
+		desc.describe(*this);
+	}
+	template<class S>
+	void name(const S&){ }
+
+	template<class T>
+	void field(T& value, cstring){
+		if constexpr(std::is_same_v<T, bool>)
+			_buf.push_back(value ? 1 : 0);
+		else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>)
+			this->writeVarint(wire::zigzag(value));
+		else if constexpr(std::is_integral_v<T>)
+			this->writeVarint(value);
+		else if constexpr(std::is_floating_point_v<T>){
+			static_assert(std::numeric_limits<T>::is_iec559, "Requires IEEE754 floating point");
+			std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t> bits;
+			std::memcpy(&bits, &value, sizeof(T));
+			this->writeFixed(bits, sizeof(T));
+		}
+		else
+			this->writeString(value);
+	}
+
+	void writeVarint(uint64_t x){
+		uint8_t tmp[10];
+		size_t n = 0;
+		while(x >= 0x80){
+			tmp[n++] = static_cast<uint8_t>(x | 0x80);
+			x >>= 7;
+		}
+		tmp[n++] = static_cast<uint8_t>(x);
+		_buf.insert(_buf.end(), tmp, tmp + n);
+	}
+	/// Write the n lower bytes of x in little-endian order
+	void writeFixed(uint64_t x, size_t n){
+		uint8_t tmp[8];
+		for(size_t i = 0; i < n; i++)
+			tmp[i] = static_cast<uint8_t>(x >> (8 * i));
+		_buf.insert(_buf.end(), tmp, tmp + n);
+	}
+	void writeString(std::string_view str){
+		this->writeVarint(str.size());
+		_buf.insert(_buf.end(), str.begin(), str.end());
+	}
+private:
+	std::vector<uint8_t>& _buf;
+};
+
+/** Deserialize class data written by BinaryWriter from a memory buffer.
+ *  Fields of type std::string_view point to the buffer (zero-copy), thus
+ *  they are only valid while the buffer is alive.
+ *  Throws std::runtime_error on truncated or malformed input.
+ */
+class BinaryReader{
+public:
+	using cstring = const char*;
+
+	BinaryReader(const uint8_t* data, size_t size): _pos(data), _end(data + size) { }
+	explicit BinaryReader(const std::vector<uint8_t>& buffer)
+		: BinaryReader(buffer.data(), buffer.size()) { }
+
+	template<class Described>
+	void visit(Described& desc){
+		desc.describe(*this);
+	}
+	/// Deserialize record preceded by the schema hash, the hash must match
+	/// the schema of Described.
+	template<class Described>
+	void visitWithSchema(Described& desc){
+		if(this->readFixed(8) != schemaHash<Described>())
+			throw std::runtime_error("Error: schema hash mismatch");
+		desc.describe(*this);
+	}
+	template<class S>
+	void name(const S&){ }
+
+	template<class T>
+	void field(T& value, cstring){
+		if constexpr(std::is_same_v<T, bool>){
+			this->need(1);
+			value = *_pos++ != 0;
+		}
+		else if constexpr(std::is_integral_v<T> && std::is_signed_v<T>)
+			value = wire::narrow<T>(wire::unzigzag(this->readVarint()));
+		else if constexpr(std::is_integral_v<T>)
+			value = wire::narrow<T>(this->readVarint());
+		else if constexpr(std::is_floating_point_v<T>){
+			auto bits = static_cast<std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>(
+				this->readFixed(sizeof(T)));
+			std::memcpy(&value, &bits, sizeof(T));
+		}
+		else
+			value = T(this->readString());
+	}
+
+	auto readVarint() -> uint64_t {
+		uint64_t x = 0;
+		for(int shift = 0; shift < 64; shift += 7){
+			this->need(1);
+			uint8_t byte = *_pos++;
+			x |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if((byte & 0x80) == 0)
+				return x;
+		}
+		throw std::runtime_error("Error: malformed varint");
+	}
+	auto readFixed(size_t n) -> uint64_t {
+		this->need(n);
+		uint64_t x = 0;
+		for(size_t i = 0; i < n; i++)
+			x |= static_cast<uint64_t>(_pos[i]) << (8 * i);
+		_pos += n;
+		return x;
+	}
+	auto readString() -> std::string_view {
+		uint64_t n = this->readVarint();
+		this->need(n);
+		auto str = std::string_view(reinterpret_cast<const char*>(_pos), n);
+		_pos += n;
+		return str;
+	}
+	auto atEnd() const -> bool { return _pos == _end; }
+	auto position() const -> const uint8_t* { return _pos; }
+	void skip(uint64_t n){
+		this->need(n);
+		_pos += n;
+	}
+private:
+	const uint8_t* _pos;
+	const uint8_t* _end;
+
+	void need(uint64_t n) const {
+		if(n > static_cast<uint64_t>(_end - _pos))
+			throw std::runtime_error("Error: unexpected end of buffer");
+	}
+};
+
+/** Columnar batch serialization of describe()-enabled classes.
+ *
+ *  The records of a batch are transposed into one column per field
+ *  (structure of arrays) on write and back into records on read. Every
+ *  column is encoded independently, which allows per-column compression:
+ *
+ *  + Integer columns: Plain (zigzag varint) or Delta (zigzag varint of the
+ *    difference to the previous value), small for sorted or sequential data.
+ *  + Floating point columns: Plain (IEEE754 little-endian).
+ *  + String columns: Plain (length + bytes) or Dictionary (table of unique
+ *    strings followed by the varint index of each value).
+ *
+ *  Batch layout:
+ *   schema hash (8 bytes) | varint records | varint columns |
+ *   per column: type tag (1 byte) | encoding (1 byte) | varint payload size | payload
+ */
+namespace columnar{
+	enum class Encoding: uint8_t { Plain = 0, Delta = 1, Dictionary = 2 };
+	enum class Compression { None, Auto };
+
+	struct Column{
+		char                          tag = 0;
+		std::vector<int64_t>          ints;
+		std::vector<double>           reals;
+		std::vector<std::string_view> strs;
+	};
+
+	/// Append the fields of a record to the columns
+	struct ColumnCollector{
+		using cstring = const char*;
+		std::vector<Column>& columns;
+		size_t               index = 0;
+
+		template<class Described>
+		void visit(Described& desc){
+			index = 0;
+			desc.describe(*this);
+		}
+		template<class S>
+		void name(const S&){ }
+		template<class T>
+		void field(T& value, cstring){
+			if(index == columns.size())
+				columns.emplace_back();
+			Column& col = columns[index++];
+			col.tag = wire::typeTag<T>();
+			if constexpr(std::is_integral_v<T>)
+				col.ints.push_back(static_cast<int64_t>(value));
+			else if constexpr(std::is_floating_point_v<T>)
+				col.reals.push_back(value);
+			else
+				col.strs.push_back(std::string_view(value));
+		}
+	};
+
+	/// Decoding state of one column
+	struct ColumnDecoder{
+		BinaryReader                  reader;
+		char                          tag;
+		Encoding                      encoding;
+		std::vector<std::string_view> table;
+		int64_t                       prev = 0;
+
+		template<class T>
+		void decode(T& value){
+			if(tag != wire::typeTag<T>())
+				throw std::runtime_error("Error: column type mismatch");
+			if constexpr(std::is_integral_v<T>){
+				int64_t x = wire::unzigzag(reader.readVarint());
+				if(encoding == Encoding::Delta)
+					x = static_cast<int64_t>(static_cast<uint64_t>(prev) + static_cast<uint64_t>(x));
+				prev = x;
+				if constexpr(std::is_same_v<T, bool>)
+					value = x != 0;
+				else if constexpr(std::is_unsigned_v<T>)
+					// Unsigned values are stored as int64 bit patterns
+					value = wire::narrow<T>(static_cast<uint64_t>(x));
+				else
+					value = wire::narrow<T>(x);
+			}
+			else if constexpr(std::is_floating_point_v<T>){
+				auto bits = static_cast<std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>(
+					reader.readFixed(sizeof(T)));
+				std::memcpy(&value, &bits, sizeof(T));
+			}
+			else if(encoding == Encoding::Dictionary){
+				uint64_t idx = reader.readVarint();
+				if(idx >= table.size())
+					throw std::runtime_error("Error: invalid dictionary index");
+				value = T(table[idx]);
+			}
+			else
+				value = T(reader.readString());
+		}
+	};
+
+	/// Count the fields of a record
+	struct FieldCounter{
+		using cstring = const char*;
+		size_t count = 0;
+
+		template<class Described>
+		void visit(Described& desc){
+			desc.describe(*this);
+		}
+		template<class S>
+		void name(const S&){ }
+		template<class T>
+		void field(T&, cstring){ count++; }
+	};
+
+	/// Number of fields, and thus of columns, computed once per type.
+	template<class Described>
+	auto fieldCount() -> size_t {
+		static const size_t count = []{
+			Described obj{};
+			FieldCounter v;
+			v.visit(obj);
+			return v.count;
+		}();
+		return count;
+	}
+
+	/// Decode one record, taking field number i from column i, so that
+	/// a batch costs one describe() call per record.
+	struct RecordDecoder{
+		using cstring = const char*;
+		std::vector<ColumnDecoder>& columns;
+		size_t                      index = 0;
+
+		template<class Described>
+		void visit(Described& desc){
+			index = 0;
+			desc.describe(*this);
+		}
+		template<class S>
+		void name(const S&){ }
+		template<class T>
+		void field(T& value, cstring){
+			// Column count checked by readBatch()
+			columns[index++].decode(value);
+		}
+	};
+
+	inline auto varintSize(uint64_t x) -> size_t {
+		size_t n = 1;
+		for(; x >= 0x80; x >>= 7) n++;
+		return n;
+	}
+	// Difference with wrap-around, so that any pair of int64 values is valid
+	inline auto delta(int64_t x, int64_t prev) -> int64_t {
+		return static_cast<int64_t>(static_cast<uint64_t>(x) - static_cast<uint64_t>(prev));
+	}
+
+	inline auto chooseIntEncoding(const std::vector<int64_t>& xs, Compression c) -> Encoding {
+		if(c == Compression::None) return Encoding::Plain;
+		size_t plain = 0, deltaSize = 0;
+		int64_t prev = 0;
+		for(int64_t x: xs){
+			plain     += varintSize(wire::zigzag(x));
+			deltaSize += varintSize(wire::zigzag(delta(x, prev)));
+			prev = x;
+		}
+		return deltaSize < plain ? Encoding::Delta : Encoding::Plain;
+	}
+
+	inline auto encodeColumn(const Column& col, Compression c, BinaryWriter& w) -> Encoding {
+		if(!col.reals.empty() || col.tag == 'd' || col.tag == 'f'){
+			for(double x: col.reals){
+				if(col.tag == 'f'){
+					float f = static_cast<float>(x);
+					uint32_t bits;
+					std::memcpy(&bits, &f, 4);
+					w.writeFixed(bits, 4);
+				} else {
+					uint64_t bits;
+					std::memcpy(&bits, &x, 8);
+					w.writeFixed(bits, 8);
+				}
+			}
+			return Encoding::Plain;
+		}
+		if(col.tag == 's'){
+			std::unordered_map<std::string_view, uint64_t> dict;
+			std::vector<uint64_t> ids;
+			if(c == Compression::Auto){
+				ids.reserve(col.strs.size());
+				for(auto str: col.strs){
+					ids.push_back(dict.emplace(str, dict.size()).first->second);
+					// Not worth it: too many distinct values
+					if(2 * dict.size() > col.strs.size() + 1){
+						dict.clear();
+						break;
+					}
+				}
+			}
+			if(dict.empty()){
+				for(auto str: col.strs)
+					w.writeString(str);
+				return Encoding::Plain;
+			}
+			std::vector<std::string_view> table(dict.size());
+			for(const auto& [str, idx]: dict)
+				table[idx] = str;
+			w.writeVarint(table.size());
+			for(auto str: table)
+				w.writeString(str);
+			for(uint64_t id: ids)
+				w.writeVarint(id);
+			return Encoding::Dictionary;
+		}
+		Encoding enc = chooseIntEncoding(col.ints, c);
+		int64_t prev = 0;
+		for(int64_t x: col.ints){
+			w.writeVarint(wire::zigzag(enc == Encoding::Delta ? delta(x, prev) : x));
+			prev = x;
+		}
+		return enc;
+	}
+
+	/// Append batch of records to buffer. Note: string fields of the
+	/// records must stay alive until the function returns.
+	template<class Described>
+	auto writeBatch(std::vector<Described>& records, std::vector<uint8_t>& buffer,
+					Compression compression = Compression::Auto) -> void
+	{
+		std::vector<Column> columns;
+		ColumnCollector collector{columns};
+		for(auto& r: records)
+			collector.visit(r);
+		auto w = BinaryWriter(buffer);
+		w.writeFixed(schemaHash<Described>(), 8);
+		w.writeVarint(records.size());
+		w.writeVarint(columns.size());
+		std::vector<uint8_t> payload;
+		payload.reserve(10 * records.size());
+		for(const auto& col: columns){
+			payload.clear();
+			auto pw = BinaryWriter(payload);
+			Encoding enc = encodeColumn(col, compression, pw);
+			buffer.push_back(static_cast<uint8_t>(col.tag));
+			buffer.push_back(static_cast<uint8_t>(enc));
+			w.writeVarint(payload.size());
+			buffer.insert(buffer.end(), payload.begin(), payload.end());
+		}
+	}
+
+	/// Read batch of records, replacing the content of records, and return
+	/// the number of bytes consumed. std::string_view fields point to the
+	/// buffer. Throws std::runtime_error on invalid input.
+	template<class Described>
+	auto readBatch(const uint8_t* data, size_t size, std::vector<Described>& records) -> size_t {
+		auto r = BinaryReader(data, size);
+		if(r.readFixed(8) != schemaHash<Described>())
+			throw std::runtime_error("Error: schema hash mismatch");
+		uint64_t nrows = r.readVarint();
+		uint64_t ncols = r.readVarint();
+		// One column per field, writeBatch() writes no column for an empty
+		// batch. Each row has at least one byte per column.
+		if(nrows > size || (ncols != fieldCount<Described>() && !(ncols == 0 && nrows == 0)))
+			throw std::runtime_error("Error: invalid batch header");
+		records.resize(nrows);
+		std::vector<ColumnDecoder> columns;
+		columns.reserve(ncols);
+		for(size_t c = 0; c < ncols; c++){
+			auto tag     = static_cast<char>(r.readFixed(1));
+			auto enc     = static_cast<Encoding>(r.readFixed(1));
+			uint64_t len = r.readVarint();
+			const uint8_t* payload = r.position();
+			r.skip(len);
+			bool valid = enc == Encoding::Plain
+				|| (enc == Encoding::Delta && tag != 's' && tag != 'd' && tag != 'f')
+				|| (enc == Encoding::Dictionary && tag == 's');
+			if(!valid)
+				throw std::runtime_error("Error: invalid column encoding");
+			auto& col = columns.emplace_back(ColumnDecoder{BinaryReader(payload, len), tag, enc, {}});
+			if(enc == Encoding::Dictionary){
+				uint64_t n = col.reader.readVarint();
+				// Each entry has at least one byte
+				if(n > len)
+					throw std::runtime_error("Error: invalid dictionary size");
+				col.table.resize(n);
+				for(auto& str: col.table)
+					str = col.reader.readString();
+			}
+		}
+		RecordDecoder decoder{columns};
+		for(auto& rec: records)
+			decoder.visit(rec);
+		return static_cast<size_t>(r.position() - data);
+	}
+}
+
 //------------ Test class ------------------//
 
 struct AClass{
@@ -168,6 +712,42 @@ struct AClass{
 	}
 };
 
+/** Same schema as AClass (signed integers share the type tag) with a
+ *  64-bit field n, used to check that out of range values are rejected. */
+struct AClassWide{
+	std::string name;
+	long   n = 0;
+	double k = 0.0;
+	long   x = 0;
+
+	template<class Visitor>
+	void describe(Visitor& v){
+		v.name("AClass");
+		v.field(n, "n");
+		v.field(k, "k");
+		v.field(x, "x");
+		v.field(name, "name");
+	}
+};
+
+/** Read-only view of AClass with the same schema, deserialized without
+ *  copying the string field (zero-copy). */
+struct AClassView{
+	std::string_view name;
+	int    n = 0;
+	double k = 0.0;
+	long   x = 0;
+
+	template<class Visitor>
+	void describe(Visitor& v){
+		v.name("AClass");
+		v.field(n, "n");
+		v.field(k, "k");
+		v.field(x, "x");
+		v.field(name, "name");
+	}
+};
+
 /** Turn non-printable characters into hexadecimal notation, for instance,
  *  the character '\n', 0x0A is printed as \x0A and 'a' is printed as 'a'.
  *  Requires: <string>, <sstream> and <iomanip>
@@ -219,6 +799,118 @@ int main(int argc, char **argv)
 	deserializer.visit(cls2);
 	descVisitor.visit(cls2);
 
+	std::cout << "\n===== EXPERIMENT 7 == Portable binary format ===========" << std::endl;
+	std::vector<uint8_t> buffer;
+	auto binWriter = BinaryWriter(buffer);
+	binWriter.visitWithSchema(cls1);
+	std::cout << "Schema hash = " << std::hex << schemaHash<AClass>() << std::dec
+			  << " ; record size = " << buffer.size() << " bytes" << std::endl;
+	std::cout << "Buffer = " << stringToHex(std::string(buffer.begin(), buffer.end())) << std::endl;
+	auto binReader = BinaryReader(buffer);
+	AClassView view;
+	binReader.visitWithSchema(view);
+	std::cout << "View = { name = " << view.name << " ; n = " << view.n
+			  << " ; k = " << view.k << " ; x = " << view.x << " }" << std::endl;
+
+	std::cout << "\n===== EXPERIMENT 8 == Benchmark ===========" << std::endl;
+	using clock = std::chrono::steady_clock;
+	auto ms = [](auto d){ return std::chrono::duration<double, std::milli>(d).count(); };
+	const size_t nrec = 1000000;
+	std::vector<AClass> records;
+	records.reserve(nrec);
+	for(size_t i = 0; i < nrec; i++)
+		records.emplace_back("record" + std::to_string(i), int(i), i * 0.5, long(i) * 1000);
+
+	buffer.reserve(32 * nrec);
+	auto t0 = clock::now();
+	auto stream = std::stringstream{};
+	auto streamWriter = SerializeVisitor(stream);
+	for(auto& r: records) streamWriter.visit(r);
+	auto t1 = clock::now();
+	buffer.clear();
+	for(auto& r: records) binWriter.visit(r);
+	auto t2 = clock::now();
+	auto bufferReader = BinaryReader(buffer);
+	size_t total = 0;
+	for(size_t i = 0; i < nrec; i++){
+		bufferReader.visit(view);
+		total += view.name.size();
+	}
+	auto t3 = clock::now();
+	std::cout << " SerializeVisitor (ostream)  = " << ms(t1 - t0) << " ms ; "
+			  << stream.str().size() << " bytes" << "\n";
+	std::cout << " BinaryWriter                = " << ms(t2 - t1) << " ms ; "
+			  << buffer.size() << " bytes ; "
+			  << nrec / (ms(t2 - t1) / 1000.0) / 1e6 << " million records/s" << "\n";
+	std::cout << " BinaryReader (zero-copy)    = " << ms(t3 - t2) << " ms ; "
+			  << nrec / (ms(t3 - t2) / 1000.0) / 1e6 << " million records/s"
+			  << " (checksum " << total << ")" << "\n";
+
+	std::cout << "\n===== EXPERIMENT 9 == Columnar batch ===========" << std::endl;
+	// Sensor-like dump: few distinct names and sequential values
+	const char* sensors[] = { "temperature", "pressure", "humidity", "voltage" };
+	for(size_t i = 0; i < nrec; i++)
+		records[i] = AClass(sensors[i % 4], int(i), 20.0 + (i % 100) * 0.1, 1600000000L + long(i) * 60);
+
+	auto t4 = clock::now();
+	std::vector<uint8_t> rows;
+	rows.reserve(32 * nrec);
+	auto rowWriter = BinaryWriter(rows);
+	for(auto& r: records) rowWriter.visit(r);
+	auto t5 = clock::now();
+	std::vector<uint8_t> batch;
+	columnar::writeBatch(records, batch);
+	auto t6 = clock::now();
+	std::vector<AClassView> views;
+	columnar::readBatch(batch.data(), batch.size(), views);
+	auto t7 = clock::now();
+	auto rowReader = BinaryReader(rows);
+	std::vector<AClassView> rowViews(nrec);
+	for(auto& v: rowViews) rowReader.visit(v);
+	auto t8 = clock::now();
+	std::vector<uint8_t> plainBatch;
+	columnar::writeBatch(records, plainBatch, columnar::Compression::None);
+
+	std::cout << " Row-wise BinaryWriter          = " << ms(t5 - t4) << " ms ; " << rows.size() << " bytes" << "\n";
+	std::cout << " Columnar writeBatch            = " << ms(t6 - t5) << " ms ; " << batch.size() << " bytes" << "\n";
+	std::cout << " Columnar without compression   = " << plainBatch.size() << " bytes" << "\n";
+	std::cout << " Row-wise BinaryReader          = " << ms(t8 - t7) << " ms" << "\n";
+	std::cout << " Columnar readBatch (zero-copy) = " << ms(t7 - t6) << " ms ; "
+			  << views.size() << " records" << "\n";
+	std::cout << " Last record = { name = " << views.back().name << " ; n = " << views.back().n
+			  << " ; k = " << views.back().k << " ; x = " << views.back().x << " }" << "\n";
+
+	// Value which does not fit in AClass::n (int)
+	std::vector<AClassWide> wide{ AClassWide{"overflow", 1L << 40, 1.0, 2} };
+	std::vector<uint8_t> wideBatch;
+	columnar::writeBatch(wide, wideBatch);
+	try {
+		std::vector<AClass> narrowRecords;
+		columnar::readBatch(wideBatch.data(), wideBatch.size(), narrowRecords);
+	} catch(const std::runtime_error& ex) {
+		std::cout << " Expected error: " << ex.what() << "\n";
+	}
+
+	// Crafted header with the right schema hash: no columns and 2^40 rows
+	std::vector<uint8_t> crafted;
+	auto craftedWriter = BinaryWriter(crafted);
+	craftedWriter.writeFixed(schemaHash<AClass>(), 8);
+	craftedWriter.writeVarint(1ULL << 40);
+	craftedWriter.writeVarint(0);
+	try {
+		std::vector<AClass> craftedRecords;
+		columnar::readBatch(crafted.data(), crafted.size(), craftedRecords);
+	} catch(const std::runtime_error& ex) {
+		std::cout << " Expected error: " << ex.what() << "\n";
+	}
+	// Empty batch, written without columns
+	std::vector<AClass> none;
+	std::vector<uint8_t> emptyBatch;
+	columnar::writeBatch(none, emptyBatch);
+	columnar::readBatch(emptyBatch.data(), emptyBatch.size(), none);
+	std::cout << " Empty batch = " << emptyBatch.size() << " bytes ; "
+			  << none.size() << " records" << "\n";
+
 	return 0;
 }
 
@@ -1,5 +1,8 @@
 // Brief:  Generic visitor pattern implemented with C++17 variants 
 // Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ visitor1-cpp17.cpp -o visitor1-cpp17.bin -std=c++1z -O2 -Wall -Wextra
 //------------------------------------------------------------------
 
 #include <iostream>
@@ -9,6 +12,9 @@
 #include <functional>
 
 #include<type_traits>
+#include <vector>
+#include <chrono>
+#include <random>
 
 // C++17 Variant std::variant and std::visit 
 #include <variant> 
@@ -94,6 +100,214 @@ auto makeVisitor(FnVisit<Circle, Result> fnCircle,
 } //-- EoF makeVisitor ----// 
 
 
+/** Helper for building a visitor from lambdas, which are inlined by
+ * std::visit, unlike the std::function objects of FunctionVisitor. */
+template<typename... Ts> struct overloaded: Ts... { using Ts::operator()...; };
+template<typename... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+
+/** Closed set of shapes stored by value, contiguously, in a vector of
+ * variants. There is no allocation per shape and std::visit dispatches
+ * on the variant index with a jump table, instead of virtual calls.
+ */
+class ShapeCollection{
+public:
+	using Shape = std::variant<Circle, Square, Blob>;
+
+	template<typename T, typename... Args>
+	auto emplace(Args&&... args) -> T& {
+		return std::get<T>(m_shapes.emplace_back(std::in_place_type<T>, std::forward<Args>(args)...));
+	}
+	auto reserve(size_t n) -> void { m_shapes.reserve(n); }
+	auto size() const -> size_t { return m_shapes.size(); }
+	auto operator[](size_t i) const -> const Shape& { return m_shapes[i]; }
+	auto begin() const { return m_shapes.begin(); }
+	auto end()   const { return m_shapes.end(); }
+
+	/// Apply visitor to all shapes
+	template<typename Visitor>
+	auto visit(Visitor&& visitor) const -> void {
+		for(const auto& s: m_shapes)
+			std::visit(visitor, s);
+	}
+	/// Fold the results of the visitor over all shapes
+	template<typename Result, typename Visitor>
+	auto accumulate(Result init, Visitor&& visitor) const -> Result {
+		for(const auto& s: m_shapes)
+			init += std::visit(visitor, s);
+		return init;
+	}
+	/// Number of shapes of type T
+	template<typename T>
+	auto count() const -> size_t {
+		return this->accumulate(size_t{0}, [](const auto& s){
+			return size_t{std::is_same_v<std::decay_t<decltype(s)>, T>};
+		});
+	}
+	auto totalArea() const -> double {
+		return this->accumulate(0.0, overloaded{
+			[](const Circle& s){ return 3.1415 * s.radius * s.radius; },
+			[](const Square& s){ return s.side * s.side; },
+			[](const Blob&    ){ return 0.0; }
+		});
+	}
+private:
+	std::vector<Shape> m_shapes;
+};
+
+// ======== Benchmark against visitor1.cpp and visitor2.cpp =============//
+
+/** Classical double dispatch (visitor1.cpp): accept() and visit() are
+ * virtual, so there are two indirect calls per shape. */
+namespace classic{
+	struct Circle; struct Square; struct Blob;
+	struct IVisitor{
+		virtual ~IVisitor() = default;
+		virtual void visit(const Circle& sh) = 0;
+		virtual void visit(const Square& sh) = 0;
+		virtual void visit(const Blob& sh) = 0;
+	};
+	struct IShape{
+		virtual ~IShape() = default;
+		virtual void accept(IVisitor& v) const = 0;
+	};
+	struct Circle: IShape{
+		double radius;
+		Circle(double radius): radius(radius) { }
+		void accept(IVisitor& v) const override { v.visit(*this); }
+	};
+	struct Square: IShape{
+		double side;
+		Square(double side): side(side) { }
+		void accept(IVisitor& v) const override { v.visit(*this); }
+	};
+	struct Blob: IShape{
+		void accept(IVisitor& v) const override { v.visit(*this); }
+	};
+	struct ComputeAreaVisitor: IVisitor{
+		double area = 0.0;
+		void visit(const Circle& s) override { area += 3.1415 * s.radius * s.radius; }
+		void visit(const Square& s) override { area += s.side * s.side; }
+		void visit(const Blob&    ) override { }
+	};
+}
+
+/** CRTP visitable shapes (visitor2.cpp) with a FunctionAdapter of
+ * std::function objects. A heterogeneous collection still needs one
+ * virtual call to recover the concrete type, plus the std::function call. */
+namespace crtp{
+	struct Circle; struct Square; struct Blob;
+	template<typename Result>
+	class FunctionAdapter{
+		template<typename T> using Func = std::function<Result (const T&)>;
+		Func<Circle> _fn_circle;
+		Func<Square> _fn_square;
+		Func<Blob>   _fn_blob;
+	public:
+		Result result{};
+		FunctionAdapter(Func<Circle> fnCircle, Func<Square> fnSquare, Func<Blob> fnBlob)
+			: _fn_circle(fnCircle), _fn_square(fnSquare), _fn_blob(fnBlob) { }
+		void visit(const Circle& sh) { result += _fn_circle(sh); }
+		void visit(const Square& sh) { result += _fn_square(sh); }
+		void visit(const Blob& sh)   { result += _fn_blob(sh); }
+	};
+	struct IShape{
+		virtual ~IShape() = default;
+		virtual void accept(FunctionAdapter<double>& v) const = 0;
+	};
+	template<typename Implementation>
+	struct VisitableShape: IShape{
+		void accept(FunctionAdapter<double>& v) const override {
+			v.visit(static_cast<const Implementation&>(*this));
+		}
+	};
+	struct Circle: VisitableShape<Circle>{
+		double radius;
+		Circle(double radius): radius(radius) { }
+	};
+	struct Square: VisitableShape<Square>{
+		double side;
+		Square(double side): side(side) { }
+	};
+	struct Blob: VisitableShape<Blob>{ };
+}
+
+template<typename Function>
+auto timeIt(Function fn) -> double {
+	auto t0 = std::chrono::steady_clock::now();
+	fn();
+	auto t1 = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+auto benchmark(size_t n, int iterations) -> void {
+	// Same random sequence of shapes for all implementations
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<int> pick(0, 2);
+	std::uniform_real_distribution<double> size(0.5, 2.0);
+	std::vector<std::pair<int, double>> spec(n);
+	for(auto& p: spec) p = { pick(rng), size(rng) };
+
+	std::vector<std::unique_ptr<classic::IShape>> classicShapes;
+	std::vector<std::unique_ptr<crtp::IShape>>    crtpShapes;
+	ShapeCollection shapes;
+	shapes.reserve(n);
+	for(const auto& [kind, x]: spec){
+		if(kind == 0){
+			classicShapes.push_back(std::make_unique<classic::Circle>(x));
+			crtpShapes.push_back(std::make_unique<crtp::Circle>(x));
+			shapes.emplace<Circle>(x);
+		} else if(kind == 1){
+			classicShapes.push_back(std::make_unique<classic::Square>(x));
+			crtpShapes.push_back(std::make_unique<crtp::Square>(x));
+			shapes.emplace<Square>(x);
+		} else {
+			classicShapes.push_back(std::make_unique<classic::Blob>());
+			crtpShapes.push_back(std::make_unique<crtp::Blob>());
+			shapes.emplace<Blob>();
+		}
+	}
+
+	double a1 = 0, a2 = 0, a3 = 0, a4 = 0;
+	double t1 = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			classic::ComputeAreaVisitor v;
+			for(const auto& s: classicShapes) s->accept(v);
+			a1 = v.area;
+		}
+	});
+	double t2 = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			auto v = crtp::FunctionAdapter<double>{
+				[](const crtp::Circle& s){ return 3.1415 * s.radius * s.radius; },
+				[](const crtp::Square& s){ return s.side * s.side; },
+				[](const crtp::Blob&    ){ return 0.0; }
+			};
+			for(const auto& s: crtpShapes) s->accept(v);
+			a2 = v.result;
+		}
+	});
+	double t3 = timeIt([&]{
+		for(int i = 0; i < iterations; i++){
+			auto v = FunctionVisitor<double>{
+				[](const Circle& s){ return 3.1415 * s.radius * s.radius; },
+				[](const Square& s){ return s.side * s.side; },
+				[](const Blob&    ){ return 0.0; }
+			};
+			a3 = shapes.accumulate(0.0, v);
+		}
+	});
+	double t4 = timeIt([&]{
+		for(int i = 0; i < iterations; i++)
+			a4 = shapes.totalArea();
+	});
+
+	std::cout << " Number of shapes = " << n << "\n";
+	std::cout << " IVisitor double dispatch (visitor1.cpp)     = " << t1 / iterations << " ms ; area = " << a1 << "\n";
+	std::cout << " CRTP + std::function (visitor2.cpp)         = " << t2 / iterations << " ms ; area = " << a2 << "\n";
+	std::cout << " std::variant + FunctionVisitor              = " << t3 / iterations << " ms ; area = " << a3 << "\n";
+	std::cout << " ShapeCollection::totalArea (overloaded)     = " << t4 / iterations << " ms ; area = " << a4 << "\n";
+}
+
 int main()
 {
 	using Shape = std::variant<Circle, Square, Blob>;	
@@ -145,6 +359,19 @@ int main()
 	std::cout << "Area of shape 1 = " << std::visit(fnVisitorArea, s1) << "\n";
 	std::cout << "Area of shape 2 = " << std::visit(fnVisitorArea, s2) << "\n";
 	std::cout << "Area of shape 3 = " << std::visit(fnVisitorArea, s3) << "\n";
+
+	std::puts("\n === EXPERIMENT 5 - ShapeCollection =================");
+	ShapeCollection shapes;
+	shapes.emplace<Circle>(3.0);
+	shapes.emplace<Square>(4.0);
+	shapes.emplace<Blob>();
+	shapes.emplace<Circle>(1.0);
+	shapes.visit(printVisitor);
+	std::cout << "Number of circles = " << shapes.count<Circle>() << "\n";
+	std::cout << "Total area        = " << shapes.totalArea() << "\n";
+
+	std::puts("\n === EXPERIMENT 6 - Benchmark =================");
+	benchmark(5000000, 5);
 	
 	return 0;
 }
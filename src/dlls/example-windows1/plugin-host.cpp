@@ -0,0 +1,364 @@
+// File:   plugin-host.cpp
+// Brief:  Hot-reloadable plugin host for the InterfaceClass C-API of
+//         testlib.hpp (Linux only: dlopen and inotify).
+// Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ testplugin.cpp -o libtestplugin.so -std=c++1z -O2 -fPIC -shared -DPLUGIN_VERSION=1
+//  $ g++ plugin-host.cpp -o plugin-host.bin -std=c++1z -O2 -Wall -pthread -ldl
+//
+// Run:
+//  $ ./plugin-host.bin ./libtestplugin.so [new-version.so]
+//
+//  The host processes requests on several threads while the plugin file is
+//  redeployed: it is rewritten with the content of new-version.so (or with
+//  itself if not given). Rebuilding libtestplugin.so with other
+//  PLUGIN_VERSION while it runs also triggers a reload.
+//---------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <iterator>
+#include <utility>
+#include <cstring>
+#include <cerrno>
+
+// Unix specific
+#include <dlfcn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h> // memfd_create (Linux, glibc >= 2.27)
+#include <fcntl.h>
+
+#include "testlib.hpp"
+
+/** Type synonym for shared library handler */
+using LibHandle = std::unique_ptr<void, std::function<void (void*)>>;
+
+/** Function table of the plugin, resolved once when a version is loaded. */
+struct PluginApi{
+	decltype(&teslib_InterfaceClass_factory)  factory;
+	decltype(&testlib_InterfaceClass_delete)  destroy;
+	decltype(&testlib_InterfaceClass_getID)   getID;
+	decltype(&testlib_InterfaceClass_setName) setName;
+	decltype(&testlib_InterfaceClass_getName) getName;
+	// Optional symbol, nullptr if not exported
+	int (* version)();
+};
+
+/** Loads a plugin shared library and reloads it whenever the file is
+ *  rewritten or replaced, without stopping the threads calling it.
+ *
+ *  + The file is watched with inotify. Each new version is copied to a
+ *    private anonymous file (memfd_create) and loaded side by side with the
+ *    current one, as dlopen() of the same path would return the already
+ *    loaded library. The copy has no name in the file system, so other
+ *    users cannot replace it before it is loaded.
+ *  + The active version is published through an atomic pointer (RCU-like):
+ *    callers pin the version with acquire(), which increments its in-flight
+ *    counter, and the library of a replaced version is only closed after its
+ *    counter drops to zero.
+ *  + A version which fails to load or lacks symbols is rejected and the
+ *    current one is kept.
+ *
+ *  Objects created through the API hold code of the library (vtables), so
+ *  they must be destroyed before the Guard which created them is released.
+ */
+class PluginHost{
+private:
+	struct Version{
+		LibHandle          lib;
+		PluginApi          api;
+		unsigned           number;
+		std::atomic<long>  inflight{0};
+	};
+public:
+	/** Pins a version of the plugin while alive. */
+	class Guard{
+	public:
+		Guard(Guard&& rhs) noexcept: m_version(std::exchange(rhs.m_version, nullptr)) { }
+		Guard(const Guard&) = delete;
+		auto operator=(const Guard&) -> Guard& = delete;
+		~Guard(){
+			if(m_version) m_version->inflight.fetch_sub(1);
+		}
+		auto operator->() const -> const PluginApi* { return &m_version->api; }
+		auto operator*()  const -> const PluginApi& { return m_version->api; }
+		/// Sequential number of the loaded version, starting from 1
+		auto generation() const -> unsigned { return m_version->number; }
+	private:
+		friend class PluginHost;
+		explicit Guard(Version* v): m_version(v) { }
+		Version* m_version;
+	};
+
+	/// Throws std::runtime_error if the first version cannot be loaded.
+	explicit PluginHost(const std::string& path)
+		: m_path(path)
+	{
+		auto v = this->loadVersion(1);
+		m_current.store(v.get());
+		m_versions.push_back(std::move(v));
+		this->startWatcher();
+	}
+	PluginHost(const PluginHost&) = delete;
+	auto operator=(const PluginHost&) -> PluginHost& = delete;
+
+	~PluginHost(){
+		m_stop = true;
+		if(m_watcher.joinable())
+			m_watcher.join();
+		if(m_inotify >= 0)
+			::close(m_inotify);
+		// Wait for in-flight calls before the libraries are closed
+		for(const auto& v: m_versions)
+			while(v->inflight.load() != 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	/// Thread-safe. Pin the current version for calling it.
+	auto acquire() -> Guard {
+		for(;;){
+			Version* v = m_current.load();
+			v->inflight.fetch_add(1);
+			// If it was replaced meanwhile, the reclaimer may have missed
+			// this increment, so it cannot be used.
+			if(m_current.load() == v)
+				return Guard(v);
+			v->inflight.fetch_sub(1);
+		}
+	}
+
+	/// Call function with the API of the current version pinned.
+	template<typename Function>
+	auto call(Function&& fn) -> decltype(fn(std::declval<const PluginApi&>())) {
+		auto guard = this->acquire();
+		return fn(*guard);
+	}
+
+	/// Thread-safe. Load the plugin file again and make it the current
+	/// version. Returns false, keeping the current one, if it fails.
+	auto reload() -> bool {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_ptr<Version> v;
+		try {
+			v = this->loadVersion(m_versions.back()->number + 1);
+		} catch(const std::runtime_error& ex) {
+			std::cerr << " [ERROR] Plugin reload failed, keeping current version: " << ex.what() << "\n";
+			m_failures++;
+			return false;
+		}
+		Version* old = m_current.exchange(v.get());
+		m_versions.push_back(std::move(v));
+		m_retired.push_back(old);
+		m_reloads++;
+		this->reclaimRetired();
+		return true;
+	}
+
+	auto generation() const -> unsigned { return m_current.load()->number; }
+	auto reloads()    const -> unsigned { return m_reloads.load(); }
+	auto failures()   const -> unsigned { return m_failures.load(); }
+	/// Number of replaced versions whose library is still loaded
+	auto pendingUnloads() const -> size_t {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_retired.size();
+	}
+
+private:
+	std::string                           m_path;
+	std::atomic<Version*>                 m_current{nullptr};
+	mutable std::mutex                    m_mutex;
+	// All versions loaded so far. The records of replaced versions are kept
+	// (a few bytes each), as acquire() may still touch their counter.
+	std::vector<std::unique_ptr<Version>> m_versions;
+	std::vector<Version*>                 m_retired;
+	std::atomic<unsigned>                 m_reloads{0};
+	std::atomic<unsigned>                 m_failures{0};
+	std::thread                           m_watcher;
+	std::atomic<bool>                     m_stop{false};
+	int                                   m_inotify = -1;
+
+	/// Copy whole file src to dst, returns false on error
+	static auto copyFile(int src, int dst) -> bool {
+		char buffer[64 * 1024];
+		for(;;){
+			ssize_t n = ::read(src, buffer, sizeof(buffer));
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) return n == 0;
+			for(ssize_t done = 0; done < n; ){
+				ssize_t k = ::write(dst, buffer + done, n - done);
+				if(k < 0 && errno == EINTR) continue;
+				if(k <= 0) return false;
+				done += k;
+			}
+		}
+	}
+
+	auto loadVersion(unsigned number) -> std::unique_ptr<Version> {
+		// Private copy, the file may be rewritten while it is loaded
+		std::string name = "plugin-host-" + std::to_string(number);
+		int src  = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+		int copy = ::memfd_create(name.c_str(), MFD_CLOEXEC);
+		bool ok  = src >= 0 && copy >= 0 && copyFile(src, copy);
+		int  err = errno;
+		if(src >= 0) ::close(src);
+		if(!ok){
+			if(copy >= 0) ::close(copy);
+			throw std::runtime_error("Error: cannot copy plugin " + m_path + ": " + std::strerror(err));
+		}
+		// The descriptor can be closed once the library is mapped
+		std::string copyPath = "/proc/self/fd/" + std::to_string(copy);
+		auto lib = LibHandle(dlopen(copyPath.c_str(), RTLD_NOW | RTLD_LOCAL),
+							 [](void* h){ dlclose(h); });
+		::close(copy);
+		if(lib == nullptr){
+			const char* err = dlerror();
+			throw std::runtime_error("Error: cannot load plugin " + m_path + ": " + (err ? err : ""));
+		}
+		auto v = std::make_unique<Version>();
+		v->number = number;
+		std::string missing;
+		auto resolve = [&](auto& fn, const char* name, bool required){
+			fn = reinterpret_cast<std::remove_reference_t<decltype(fn)>>(dlsym(lib.get(), name));
+			if(fn == nullptr && required)
+				missing += std::string(missing.empty() ? "" : ", ") + name;
+		};
+		resolve(v->api.factory, "teslib_InterfaceClass_factory",   true);
+		resolve(v->api.destroy, "testlib_InterfaceClass_delete",   true);
+		resolve(v->api.getID,   "testlib_InterfaceClass_getID",    true);
+		resolve(v->api.setName, "testlib_InterfaceClass_setName",  true);
+		resolve(v->api.getName, "testlib_InterfaceClass_getName",  true);
+		resolve(v->api.version, "testlib_plugin_version",          false);
+		if(!missing.empty())
+			throw std::runtime_error("Error: missing symbols in plugin " + m_path + ": " + missing);
+		v->lib = std::move(lib);
+		return v;
+	}
+
+	// Requires m_mutex locked. Close libraries without in-flight calls.
+	auto reclaimRetired() -> void {
+		auto it = m_retired.begin();
+		while(it != m_retired.end()){
+			if((*it)->inflight.load() == 0){
+				(*it)->lib.reset();
+				it = m_retired.erase(it);
+			} else
+				++it;
+		}
+	}
+
+	auto startWatcher() -> void {
+		auto slash = m_path.find_last_of('/');
+		std::string dir  = slash == std::string::npos ? "." : m_path.substr(0, slash + 1);
+		std::string file = slash == std::string::npos ? m_path : m_path.substr(slash + 1);
+		m_inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		// The directory is watched, as the file may be replaced by rename
+		if(m_inotify < 0 || ::inotify_add_watch(m_inotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+			throw std::runtime_error("Error: cannot watch directory " + dir);
+		m_watcher = std::thread([this, file]{ this->watchLoop(file); });
+	}
+
+	auto watchLoop(const std::string& file) -> void {
+		alignas(inotify_event) char buffer[4096];
+		while(!m_stop){
+			pollfd pfd{m_inotify, POLLIN, 0};
+			bool changed = false;
+			if(::poll(&pfd, 1, 50) > 0){
+				ssize_t n;
+				while((n = ::read(m_inotify, buffer, sizeof(buffer))) > 0){
+					for(char* p = buffer; p < buffer + n; ){
+						auto ev = reinterpret_cast<inotify_event*>(p);
+						if(ev->len > 0 && file == ev->name)
+							changed = true;
+						p += sizeof(inotify_event) + ev->len;
+					}
+				}
+			}
+			if(changed)
+				this->reload();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			this->reclaimRetired();
+		}
+	}
+};
+
+int main(int argc, char** argv){
+	const std::string path    = argc > 1 ? argv[1] : "./libtestplugin.so";
+	const std::string newPath = argc > 2 ? argv[2] : path;
+	const char nl = '\n';
+
+	PluginHost host(path);
+	host.call([&](const PluginApi& api){
+		std::cout << " [INFO] Loaded plugin " << path << " ; version = "
+				  << (api.version ? api.version() : 0) << nl;
+	});
+
+	// Request processing threads: count requests served per plugin version
+	const int nthreads = 4;
+	std::atomic<bool> running{true};
+	std::atomic<long> errors{0};
+	std::mutex countsMutex;
+	std::map<unsigned, long> counts;
+	std::vector<std::thread> workers;
+	for(int t = 0; t < nthreads; t++)
+		workers.emplace_back([&]{
+			std::map<unsigned, long> local;
+			while(running){
+				auto api = host.acquire();
+				InterfaceClass* obj = api->factory("ImplementationA");
+				if(obj == nullptr){
+					errors++;
+					continue;
+				}
+				api->setName(obj, "request");
+				if(std::string(api->getID(obj)) != "ImplementationA")
+					errors++;
+				api->destroy(obj);
+				local[api.generation()]++;
+			}
+			std::lock_guard<std::mutex> lock(countsMutex);
+			for(auto [gen, n]: local)
+				counts[gen] += n;
+		});
+
+	// Simulate deployments: rewrite the plugin file while requests run
+	const int deployments = 3;
+	for(int i = 0; i < deployments; i++){
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		std::string bytes;
+		{
+			std::ifstream src(newPath, std::ios::binary);
+			bytes.assign(std::istreambuf_iterator<char>(src), {});
+		}
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << bytes;
+		std::cout << " [INFO] Deployed " << newPath << " over " << path << nl;
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	running = false;
+	for(auto& th: workers)
+		th.join();
+
+	for(auto [gen, n]: counts)
+		std::cout << " Requests served by version #" << gen << " = " << n << nl;
+	std::cout << " Reloads = " << host.reloads() << " ; failures = " << host.failures()
+			  << " ; errors = " << errors << " ; libraries pending unload = " << host.pendingUnloads() << nl;
+	host.call([&](const PluginApi& api){
+		InterfaceClass* obj = api.factory("ImplementationB");
+		api.setName(obj, "last");
+		std::cout << " Current version #" << host.generation() << " => " << api.getName(obj) << nl;
+		api.destroy(obj);
+	});
+	return 0;
+}
@@ -0,0 +1,76 @@
+// File:   testplugin.cpp
+// Brief:  Unix shared library implementing the InterfaceClass C-API of
+//         testlib.hpp, used as plugin by plugin-host.cpp.
+// Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ testplugin.cpp -o libtestplugin.so -std=c++1z -O2 -fPIC -shared -DPLUGIN_VERSION=1
+//---------------------------------------------------------------
+
+#include <string>
+
+#include "testlib.hpp"
+
+#ifndef PLUGIN_VERSION
+  #define PLUGIN_VERSION 1
+#endif
+
+namespace {
+	template<const char* ClassID>
+	class Implementation: public InterfaceClass
+	{
+	private:
+		std::string m_name;
+	public:
+		Implementation(): m_name(std::string("Unnamed-") + ClassID) { }
+		const char* getID() const {
+			return ClassID;
+		}
+		void setName(const char* name) {
+			m_name = name;
+			m_name += " (v" + std::to_string(PLUGIN_VERSION) + ")";
+		}
+		const char* getName() {
+			return m_name.c_str();
+		}
+	};
+
+	constexpr char idImplementationA[] = "ImplementationA";
+	constexpr char idImplementationB[] = "ImplementationB";
+}
+
+/** Version of the plugin, optional symbol for the host */
+EXPORT_C int testlib_plugin_version()
+{
+	return PLUGIN_VERSION;
+}
+
+EXPORT_C InterfaceClass*
+teslib_InterfaceClass_factory(const char* class_id)
+{
+	auto s = std::string(class_id);
+	if(s == idImplementationA)
+		return new Implementation<idImplementationA>();
+	if(s == idImplementationB)
+		return new Implementation<idImplementationB>();
+	return nullptr;
+}
+
+EXPORT_C void testlib_InterfaceClass_delete(InterfaceClass* hinst)
+{
+	delete hinst;
+}
+EXPORT_C
+const char* testlib_InterfaceClass_getID(InterfaceClass* hinst)
+{
+	return hinst->getID();
+}
+EXPORT_C
+void testlib_InterfaceClass_setName(InterfaceClass* hinst, const char* name)
+{
+	hinst->setName(name);
+}
+EXPORT_C
+const char* testlib_InterfaceClass_getName(InterfaceClass* hinst){
+	return hinst->getName();
+}
@@ -3,12 +3,19 @@
 //
 // Compile with:
 // $ clang++ mymodule.cpp -o mymodule.so -g -std=c++1z -fPIC -shared -I/usr/include/python3.6m  
+//
+// Compile with vectorized kernels enabled (vectorExp, vectorLog, ...):
+// $ g++ mymodule.cpp -o mymodule.so -std=c++1z -fPIC -shared -O3 -march=native -fopenmp-simd -fno-trapping-math -I/usr/include/python3.6m
 //-------------------------------------------------------
 
 #include <iostream>
 #include <string>
 #include <functional>
 #include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 // Solve Mingw error: '::hyport' has not been declared 
 #include <math.h>
@@ -60,6 +67,10 @@ PyObject* returnTuple(PyObject* self, PyObject* args);
 PyObject* returnDictionary(PyObject* self, PyObject* args);
 PyObject* tabulateFunction(PyObject* self, PyObject* args);
 PyObject* computeStatistics(PyObject* self, PyObject* args);
+PyObject* vectorExp(PyObject* self, PyObject* args);
+PyObject* vectorLog(PyObject* self, PyObject* args);
+PyObject* vectorSin(PyObject* self, PyObject* args);
+PyObject* vectorCos(PyObject* self, PyObject* args);
 
 static PyMethodDef ModuleFunctions [] =
 {
@@ -82,6 +93,22 @@ static PyMethodDef ModuleFunctions [] =
 	,{"computeStatistics", &computeStatistics, METH_VARARGS, nullptr}
 	,{"tabulateFunction", tabulateFunction, METH_VARARGS,
 	  "Tabulate some mathematical function or callable object"}
+
+	// Vectorized kernels: accept any object supporting the buffer protocol
+	// with float64 items, for instance array.array('d', ...) or numpy arrays.
+	,{"vectorExp", vectorExp, METH_VARARGS,
+	  "vectorExp(xs, out = xs) -> None"
+	  "\n Computes exp(x) for every element of float64 buffer xs and writes the"
+	  "\n result into the float64 buffer out. If out is omitted, xs is overwritten."}
+	,{"vectorLog", vectorLog, METH_VARARGS,
+	  "vectorLog(xs, out = xs) -> None"
+	  "\n Computes natural logarithm log(x) element-wise over float64 buffers."}
+	,{"vectorSin", vectorSin, METH_VARARGS,
+	  "vectorSin(xs, out = xs) -> None"
+	  "\n Computes sin(x) element-wise over float64 buffers."}
+	,{"vectorCos", vectorCos, METH_VARARGS,
+	  "vectorCos(xs, out = xs) -> None"
+	  "\n Computes cos(x) element-wise over float64 buffers."}
 	// Sentinel value used to indicate the end of function listing.
 	// All function listing must end with this value.
 	,{nullptr, nullptr, 0, nullptr}									
@@ -199,16 +226,16 @@ auto taylorSeriesExp(PyObject* self, PyObject* args) -> PyObject*
 	
 	// Compute exponential taylor series available at
 	// https://www.mathsisfun.com/algebra/taylor-series.html
-	unsigned long factorial = 1;
-	double        xpower    = 1.0;
+	//
+	// The next term is obtained from the previous one with the recurrence
+	// term(n) = term(n - 1) * x / n instead of computing x^n / n! as
+	// (unsigned long) factorial overflows after 20 terms.
 	double        sum       = 0.0;
-	double        term      = 0.0;
+	double        term      = 1.0;
 	size_t        idx       = 1;
 	do{
-		term      = xpower / factorial;
 		sum       = sum + term;
-		xpower    = xpower * x ;
-		factorial = factorial * idx;		
+		term      = term * x / idx;
 		idx++;
 	} while(idx <= maxiter && std::abs(term) > std::abs(sum) * tol );
 	// Return float point constnat NAN (Not a Number)
@@ -355,3 +382,301 @@ PyObject* tabulateFunction(PyObject* self, PyObject* args)
 	}
 	Py_RETURN_NONE;
 }
+
+
+// ========= Vectorized elementary-function kernels ======== //
+
+/** Branch-free elementary functions evaluated over whole arrays.
+ *  
+ *  Each function performs an argument reduction to a small interval
+ *  and then evaluates a truncated Taylor series with Horner's method.
+ *  As the number of terms is fixed and there are no data-dependent
+ *  branches, loops over those functions can be auto-vectorized by the
+ *  compiler (SSE2/AVX2/AVX512) when built with -O3 -march=native
+ *  -fno-trapping-math (GCC does not if-convert comparisons otherwise).
+ */
+namespace VecMath
+{
+	// Shifter 1.5 * 2^52: (x + shifter) - shifter rounds x to the nearest
+	// integer and the lowest bits of (x + shifter) hold this integer.
+	constexpr double   shifter      = 6755399441055744.0;
+	constexpr uint64_t shifterBits  = 0x4338000000000000ULL;
+
+	constexpr double log2e    = 1.4426950408889634074;
+	constexpr double ln2      = 0.69314718055994530942;
+	// ln(2) split into high and low parts (Cody-Waite reduction)
+	constexpr double ln2Hi    = 6.93147180369123816490e-01;
+	constexpr double ln2Lo    = 1.90821492927058770002e-10;
+	constexpr double sqrt2    = 1.41421356237309504880;
+	constexpr double twoOverPi = 0.63661977236758134308;
+	// pi/2 split into three parts (Cody-Waite reduction)
+	constexpr double pio2Hi   = 1.57079632673412561417e+00;
+	constexpr double pio2Med  = 6.07710050650619224932e-11;
+	constexpr double pio2Lo   = 2.02226624879595063154e-21;
+
+	inline double fromBits(uint64_t bits)
+	{
+		double x;
+		std::memcpy(&x, &bits, sizeof(double));
+		return x;
+	}
+
+	inline uint64_t toBits(double x)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &x, sizeof(double));
+		return bits;
+	}
+
+	/** Computes exp(x) = 2^k * exp(r), where r = x - k * ln(2) and |r| <= ln(2) / 2 */
+	inline double exp(double x)
+	{
+		double xc = x > 709.79 ? 709.79 : x;
+		xc = xc < -745.14 ? -745.14 : xc;
+		double t  = xc * log2e + shifter;
+		double k  = t - shifter;
+		int64_t ki = static_cast<int64_t>(toBits(t) - shifterBits);
+		double r  = (xc - k * ln2Hi) - k * ln2Lo;
+		// Taylor series: sum r^n / n! for n = 0 to 13 
+		double p = 1.0 / 6227020800.0;
+		p = p * r + 1.0 / 479001600.0;
+		p = p * r + 1.0 / 39916800.0;
+		p = p * r + 1.0 / 3628800.0;
+		p = p * r + 1.0 / 362880.0;
+		p = p * r + 1.0 / 40320.0;
+		p = p * r + 1.0 / 5040.0;
+		p = p * r + 1.0 / 720.0;
+		p = p * r + 1.0 / 120.0;
+		p = p * r + 1.0 / 24.0;
+		p = p * r + 1.0 / 6.0;
+		p = p * r + 0.5;
+		p = p * r + 1.0;
+		p = p * r + 1.0;
+		// 2^k is applied in two steps, so that results near overflow
+		// (k = 1024) and subnormal results (k < -1022) are representable.
+		int64_t k1 = ki >> 1;
+		int64_t k2 = ki - k1;
+		double y = p * fromBits(static_cast<uint64_t>(k1 + 1023) << 52)
+			         * fromBits(static_cast<uint64_t>(k2 + 1023) << 52);
+		y = x >  709.79 ? HUGE_VAL : y;
+		y = x < -745.14 ? 0.0 : y;
+		return x != x ? x : y;
+	}
+
+	/** Computes log(x) = e * ln(2) + log(m), where x = m * 2^e, sqrt(1/2) <= m < sqrt(2).
+	 *  The term log(m) is computed with the series 2 * atanh(s), s = (m - 1) / (m + 1) */
+	inline double log(double x)
+	{
+		// Scale subnormal numbers by 2^54 
+		bool     subnormal = x < 2.2250738585072014e-308;
+		double   xs   = subnormal ? x * 18014398509481984.0 : x;
+		uint64_t bits = toBits(xs);
+		int64_t  e    = static_cast<int64_t>((bits >> 52) & 0x7FF) - (subnormal ? 1023 + 54 : 1023);
+		double   m    = fromBits((bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL);
+		bool     big  = m > sqrt2;
+		m = big ? m * 0.5 : m;
+		double   de = static_cast<double>(e) + (big ? 1.0 : 0.0);
+		double   s  = (m - 1.0) / (m + 1.0);
+		double   s2 = s * s;
+		// Taylor series: atanh(s) = sum s^(2n + 1) / (2n + 1) for n = 0 to 10
+		double p = 1.0 / 21.0;
+		p = p * s2 + 1.0 / 19.0;
+		p = p * s2 + 1.0 / 17.0;
+		p = p * s2 + 1.0 / 15.0;
+		p = p * s2 + 1.0 / 13.0;
+		p = p * s2 + 1.0 / 11.0;
+		p = p * s2 + 1.0 / 9.0;
+		p = p * s2 + 1.0 / 7.0;
+		p = p * s2 + 1.0 / 5.0;
+		p = p * s2 + 1.0 / 3.0;
+		p = p * s2 + 1.0;
+		double y = (de * ln2Hi + 2.0 * s * p) + de * ln2Lo;
+		y = x == 0.0 ? -HUGE_VAL : y;
+		y = x <  0.0 ? NAN       : y;
+		y = x == HUGE_VAL ? x : y;
+		return x != x ? x : y;
+	}
+
+	/** Taylor series of sin(r) for |r| <= pi / 4 */
+	inline double sinPoly(double r)
+	{
+		double r2 = r * r;
+		double p = 1.0 / 355687428096000.0;
+		p = -p * r2 + 1.0 / 1307674368000.0;
+		p = -p * r2 + 1.0 / 6227020800.0;
+		p = -p * r2 + 1.0 / 39916800.0;
+		p = -p * r2 + 1.0 / 362880.0;
+		p = -p * r2 + 1.0 / 5040.0;
+		p = -p * r2 + 1.0 / 120.0;
+		p = -p * r2 + 1.0 / 6.0;
+		p = -p * r2 + 1.0;
+		return p * r;
+	}
+
+	/** Taylor series of cos(r) for |r| <= pi / 4 */
+	inline double cosPoly(double r)
+	{
+		double r2 = r * r;
+		double p = 1.0 / 6402373705728000.0;
+		p = -p * r2 + 1.0 / 20922789888000.0;
+		p = -p * r2 + 1.0 / 87178291200.0;
+		p = -p * r2 + 1.0 / 479001600.0;
+		p = -p * r2 + 1.0 / 3628800.0;
+		p = -p * r2 + 1.0 / 40320.0;
+		p = -p * r2 + 1.0 / 720.0;
+		p = -p * r2 + 1.0 / 24.0;
+		p = -p * r2 + 0.5;
+		p = -p * r2 + 1.0;
+		return p;
+	}
+
+	/** Largest |x| accurately reduced by reducePio2(). */
+	constexpr double reduceLimit = 1e5;
+
+	/** Reduces x to r = x - k * pi / 2 and returns the quadrant k mod 4. 
+	 *  Note: accurate for |x| < reduceLimit, larger arguments require
+	 *  Payne-Hanek reduction (see applyReduced()). */
+	inline uint64_t reducePio2(double x, double& r)
+	{
+		double t = x * twoOverPi + shifter;
+		double k = t - shifter;
+		r = ((x - k * pio2Hi) - k * pio2Med) - k * pio2Lo;
+		return toBits(t) & 3;
+	}
+
+	inline double sin(double x)
+	{
+		double r;
+		uint64_t q = reducePio2(x, r);
+		double s = sinPoly(r);
+		double c = cosPoly(r);
+		double y = (q & 1) ? c : s;
+		return (q & 2) ? -y : y;
+	}
+
+	inline double cos(double x)
+	{
+		double r;
+		uint64_t q = reducePio2(x, r);
+		double s = sinPoly(r);
+		double c = cosPoly(r);
+		double y = (q & 1) ? s : c;
+		return ((q + 1) & 2) ? -y : y;
+	}
+
+	/** Applies the kernel to every element. Input and output may alias. */
+	template<typename Kernel>
+	void apply(Kernel kernel, const double* xs, double* out, size_t n)
+	{
+	    #pragma omp simd 
+		for(size_t i = 0; i < n; i++)
+			out[i] = kernel(xs[i]);
+	}
+
+	/** Like apply() for kernels using reducePio2(): elements with
+	 *  |x| >= reduceLimit, infinities and NaNs are recomputed with the
+	 *  scalar fallback (std::sin, std::cos). Input and output may alias,
+	 *  so the input is saved in blocks before the vectorized pass. */
+	template<typename Kernel, typename Fallback>
+	void applyReduced(Kernel kernel, Fallback fallback, const double* xs, double* out, size_t n)
+	{
+		constexpr size_t block = 256;
+		double saved[block];
+		for(size_t i0 = 0; i0 < n; i0 += block){
+			size_t m = std::min(block, n - i0);
+			bool large = false;
+			for(size_t i = 0; i < m; i++){
+				saved[i] = xs[i0 + i];
+				large |= !(std::fabs(saved[i]) < reduceLimit);
+			}
+			apply(kernel, saved, out + i0, m);
+			if(!large)
+				continue;
+			for(size_t i = 0; i < m; i++)
+				if(!(std::fabs(saved[i]) < reduceLimit))
+					out[i0 + i] = fallback(saved[i]);
+		}
+	}
+}
+
+/** Parses arguments (xs, out = xs), where xs and out are float64 buffers
+ *  with the same number of elements, and calls compute(xs, out, n).
+ *  The GIL is released during the computation. 
+ */
+template<typename Compute>
+PyObject* applyVectorKernel(PyObject* args, Compute compute)
+{
+	PyObject* pInput  = nullptr;
+	PyObject* pOutput = nullptr;
+	if(!PyArg_ParseTuple(args, "O|O", &pInput, &pOutput))
+		return nullptr;
+	if(pOutput == nullptr)
+		pOutput = pInput;
+
+	Py_buffer input;
+	Py_buffer output;
+	if(PyObject_GetBuffer(pInput, &input, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0)
+		return nullptr;
+	if(PyObject_GetBuffer(pOutput, &output
+						  , PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) < 0)
+	{
+		PyBuffer_Release(&input);
+		return nullptr;
+	}
+
+	auto isFloat64 = [](const Py_buffer& b){
+		return b.itemsize == sizeof(double)
+			&& b.format != nullptr && std::strcmp(b.format, "d") == 0;
+	};
+	const char* error = nullptr;
+	if(!isFloat64(input) || !isFloat64(output))
+		error = "Error: expected buffers of float64 (double) elements.";
+	else if(input.len != output.len)
+		error = "Error: input and output buffers must have the same size.";
+
+	if(error == nullptr){
+		auto xs  = static_cast<const double*>(input.buf);
+		auto out = static_cast<double*>(output.buf);
+		size_t n = static_cast<size_t>(input.len) / sizeof(double);
+		Py_BEGIN_ALLOW_THREADS
+		compute(xs, out, n);
+		Py_END_ALLOW_THREADS
+	}
+	PyBuffer_Release(&input);
+	PyBuffer_Release(&output);
+	if(error != nullptr){
+		PyErr_SetString(PyExc_TypeError, error);
+		return nullptr;
+	}
+	Py_RETURN_NONE;
+}
+
+PyObject* vectorExp(PyObject* self, PyObject* args)
+{
+	return applyVectorKernel(args, [](const double* xs, double* out, size_t n){
+		VecMath::apply([](double x){ return VecMath::exp(x); }, xs, out, n);
+	});
+}
+
+PyObject* vectorLog(PyObject* self, PyObject* args)
+{
+	return applyVectorKernel(args, [](const double* xs, double* out, size_t n){
+		VecMath::apply([](double x){ return VecMath::log(x); }, xs, out, n);
+	});
+}
+
+PyObject* vectorSin(PyObject* self, PyObject* args)
+{
+	return applyVectorKernel(args, [](const double* xs, double* out, size_t n){
+		VecMath::applyReduced([](double x){ return VecMath::sin(x); },
+							  [](double x){ return std::sin(x); }, xs, out, n);
+	});
+}
+
+PyObject* vectorCos(PyObject* self, PyObject* args)
+{
+	return applyVectorKernel(args, [](const double* xs, double* out, size_t n){
+		VecMath::applyReduced([](double x){ return VecMath::cos(x); },
+							  [](double x){ return std::cos(x); }, xs, out, n);
+	});
+}
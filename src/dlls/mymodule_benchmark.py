@@ -0,0 +1,66 @@
+#  Benchmark of mymodule vectorized kernels against NumPy and math module.
+#
+#  Build the module with optimizations enabled before running:
+#  $ g++ mymodule.cpp -o mymodule.so -std=c++1z -fPIC -shared -O3 -march=native -fopenmp-simd -fno-trapping-math -I/usr/include/python3.6m
+#  $ python3 mymodule_benchmark.py
+#
+import array
+import math
+import random
+import timeit
+
+import mymodule as m
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+N       = 1000000
+REPEAT  = 5
+
+def bench(name, fn):
+    t = min(timeit.repeat(fn, number = 1, repeat = REPEAT))
+    print(" {0:<28} {1:10.3f} ms  {2:8.2f} ns/element".format(name, t * 1e3, t * 1e9 / N))
+
+def max_error(out, xs, fn):
+    return max(abs(y - fn(x)) / max(1.0, abs(fn(x))) for x, y in zip(xs, out))
+
+def check_large_arguments():
+    """ sin/cos must agree with math module beyond the fast reduction range. """
+    xs = [1e5, -1e5, 123456.789, 1e10, -3.3e15, 1e20, 1.7e308, float("inf"), float("nan")]
+    xs += [random.uniform(-1e22, 1e22) for _ in range(1000)]
+    for (kernel, ref) in [(m.vectorSin, math.sin), (m.vectorCos, math.cos)]:
+        out = array.array('d', xs)
+        kernel(out)
+        for x, y in zip(xs, out):
+            if math.isinf(x) or math.isnan(x):
+                assert math.isnan(y), (ref.__name__, x, y)
+            else:
+                assert abs(y - ref(x)) <= 1e-15, (ref.__name__, x, y, ref(x))
+    print(" [OK] sin/cos large argument check passed")
+
+check_large_arguments()
+
+cases = [
+      ("exp", m.vectorExp, math.exp, lambda: [random.uniform(-700, 700)  for _ in range(N)], "exp")
+    , ("log", m.vectorLog, math.log, lambda: [random.uniform(1e-10, 1e10) for _ in range(N)], "log")
+    , ("sin", m.vectorSin, math.sin, lambda: [random.uniform(-1e3, 1e3)  for _ in range(N)], "sin")
+    , ("cos", m.vectorCos, math.cos, lambda: [random.uniform(-1e3, 1e3)  for _ in range(N)], "cos")
+]
+
+for (name, kernel, ref, gen, npname) in cases:
+    xs  = gen()
+    inp = array.array('d', xs)
+    out = array.array('d', bytes(8 * N))
+    print("\n ===== Function: {0} - N = {1} =====".format(name, N))
+    kernel(inp, out)
+    print(" Max relative error vs. math.{0} = {1:.3e}".format(name, max_error(out, xs, ref)))
+    bench("mymodule.vector" + name.capitalize(), lambda: kernel(inp, out))
+    bench("math." + name + " (list comp.)", lambda: [ref(x) for x in xs])
+    if np is not None:
+        a = np.array(xs)
+        b = np.empty_like(a)
+        f = getattr(np, npname)
+        bench("numpy." + npname + "(out = b)", lambda: f(a, out = b))
+        bench("mymodule (numpy arrays)", lambda: kernel(a, b))
@@ -1,6 +1,7 @@
 // Brief: C++ Wrapper example to GNU Scientific Library Vector.
 // Author: Caio Rodrigues
-// Compile with: $ clang++ gsl-vector-wrapper.cpp -std=c++11 -Wall -Wextra -g -lgsl -lgslcblas -o out.bin
+// Compile with: $ clang++ gsl-vector-wrapper.cpp -std=c++11 -Wall -Wextra -g -O2 -lgsl -lgslcblas -o out.bin
+// Or link against an optimized BLAS: $ ... -lgsl -lopenblas -o out.bin
 // Run with:     $ ./out.bin
 // 
 // GNU Scientific Library - C++ Linear Algebra Wrapper
@@ -13,6 +14,10 @@
 #include <iomanip>
 #include <vector>
 #include <cassert>
+#include <stdexcept>
+#include <utility>
+#include <chrono>
+#include <algorithm>
 
 // Install GNU Scientific Library on Fedora with:
 // $ sudo dnf install gsl-devel.x86_64
@@ -32,7 +37,57 @@
   R__LOAD_LIBRARY(/lib64/libgsl.so);
 #endif 
 
-class GSLVector{
+/** Expression templates: operations over vectors such as (a * 1.5 + b * 2.5)
+ *  return lightweight expression objects instead of allocating a new
+ *  vector for each intermediate result. The whole expression is evaluated
+ *  in a single loop only when it is assigned to a GSLVector.
+ *  
+ *  Any class deriving from VectorExpr<Derived> must implement:
+ *   + size_t size() const      => Number of elements.
+ *   + double eval(size_t) const => Value of the i-th element.
+ *
+ *  Note: expressions hold references to the vectors, so they must not
+ *  outlive them. Store the result in a GSLVector, not in an auto variable.
+ */
+template<typename Derived>
+struct VectorExpr{
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+    size_t size()         const { return self().size(); }
+    double eval(size_t i) const { return self().eval(i); }
+};
+
+class GSLVector;
+
+/// Vectors are stored by reference in expression nodes, sub-expressions by value.
+template<typename E> struct ExprStorage            { using type = const E; };
+template<>           struct ExprStorage<GSLVector> { using type = const GSLVector&; };
+
+template<typename L, typename R, typename Op>
+struct BinaryExpr: public VectorExpr<BinaryExpr<L, R, Op>>{
+    typename ExprStorage<L>::type lhs;
+    typename ExprStorage<R>::type rhs;
+    BinaryExpr(const L& lhs, const R& rhs): lhs(lhs), rhs(rhs){
+        if(lhs.size() != rhs.size())
+            throw std::invalid_argument("Vectors of different sizes");
+    }
+    size_t size()         const { return lhs.size(); }
+    double eval(size_t i) const { return Op::apply(lhs.eval(i), rhs.eval(i)); }
+};
+
+template<typename E, typename Op>
+struct ScalarExpr: public VectorExpr<ScalarExpr<E, Op>>{
+    typename ExprStorage<E>::type expr;
+    double                        x;
+    ScalarExpr(const E& expr, double x): expr(expr), x(x){}
+    size_t size()         const { return expr.size(); }
+    double eval(size_t i) const { return Op::apply(expr.eval(i), x); }
+};
+
+struct OpAdd { static double apply(double a, double b){ return a + b; } };
+struct OpSub { static double apply(double a, double b){ return a - b; } };
+struct OpMul { static double apply(double a, double b){ return a * b; } };
+
+class GSLVector: public VectorExpr<GSLVector>{
 private:
     gsl_vector* m_hnd;
     int m_size;
@@ -47,22 +102,57 @@ public:
         this->m_hnd = gsl_vector_alloc(m_size);
         gsl_vector_set_all(m_hnd, x);
     }
-    // Copy constructor 
-    GSLVector(const GSLVector& src){
-        m_size = src.m_size;
+    // Copy constructor, a copy of a moved-from vector is also empty
+    GSLVector(const GSLVector& src): m_hnd(nullptr), m_size(src.m_size){
+        if(src.m_hnd == nullptr) return;
         m_hnd = gsl_vector_alloc(src.m_size);
         gsl_vector_memcpy(m_hnd, src.m_hnd);
+    }
+    // Move constructor - steals the buffer, no allocation. The moved-from
+    // vector is empty: size() == 0 and data() == nullptr. It can only be
+    // destroyed, assigned, copied or printed.
+    GSLVector(GSLVector&& src) noexcept: m_hnd(src.m_hnd), m_size(src.m_size){
+        src.m_hnd  = nullptr;
+        src.m_size = 0;
+    }
+    // Evaluates an expression with a single allocation and a single loop.
+    template<typename E>
+    GSLVector(const VectorExpr<E>& expr){
+        m_size = expr.size();
+        m_hnd  = gsl_vector_alloc(m_size);
+        this->assign(expr);
     }
 	// Copy assignment operator
     GSLVector& operator= (const GSLVector& src){
 		std::cerr << " [TRACE] Copy assignment operator." << "\n";
-        if(m_size != src.m_size){
-			gsl_vector_free(m_hnd);
-			m_hnd = gsl_vector_alloc(src.m_size);
+        if(this == &src) return *this;
+        if(m_size != src.m_size || m_hnd == nullptr || src.m_hnd == nullptr){
+			if(m_hnd != nullptr) gsl_vector_free(m_hnd);
+			m_hnd  = src.m_hnd != nullptr ? gsl_vector_alloc(src.m_size) : nullptr;
+            m_size = src.m_size;
 		}        
-        gsl_vector_memcpy(m_hnd, src.m_hnd);
+        if(m_hnd != nullptr) gsl_vector_memcpy(m_hnd, src.m_hnd);
 		return *this;
     }	
+    // Move assignment operator 
+    GSLVector& operator= (GSLVector&& src) noexcept {
+        std::swap(m_hnd, src.m_hnd);
+        std::swap(m_size, src.m_size);
+        return *this;
+    }
+    // Assignment from expression: reuses the current buffer if the sizes
+    // are equal. Aliasing such as v = v * 2.0 + w is safe since the i-th
+    // element of the result only depends on the i-th element of the operands.
+    template<typename E>
+    GSLVector& operator= (const VectorExpr<E>& expr){
+        if(static_cast<size_t>(m_size) != expr.size()){
+            if(m_hnd != nullptr) gsl_vector_free(m_hnd);
+            m_size = expr.size();
+            m_hnd  = gsl_vector_alloc(m_size);
+        }
+        this->assign(expr);
+        return *this;
+    }
     // Destructor 
     ~GSLVector(){
 		if(m_hnd != nullptr)
@@ -72,6 +162,13 @@ public:
 
     gsl_vector* data(){
         return this->m_hnd;
+    }
+    const gsl_vector* data() const {
+        return this->m_hnd;
+    }
+    // Direct access to element without function call, used by expressions. 
+    double eval(size_t i) const {
+        return m_hnd->data[i * m_hnd->stride];
     }
 	struct ElementProxy{
 		GSLVector* ptr;
@@ -103,28 +200,234 @@ public:
     double min() const {
         return gsl_vector_min(m_hnd);
     }
-    GSLVector operator + (const GSLVector& va){
-        // Invoke copy constructor 
-        GSLVector vec2 = *this;
-        gsl_vector_add(vec2.m_hnd, va.m_hnd);
-        return vec2;
-    }
-    GSLVector operator * (double scale){
-        // Invoke copy constructor 
-        GSLVector vec2 = *this;
-        gsl_vector_scale(vec2.m_hnd, scale);
-        return vec2;
-    }
     friend std::ostream& operator<<(std::ostream& os, const GSLVector& vec){
         os << "[" << vec.m_size << "](";
-        for(int i = 0; i < vec.m_size; i++){
+        // Moved-from vectors have no buffer
+        for(int i = 0; vec.m_hnd != nullptr && i < vec.m_size; i++){
             os << std::setprecision(4) << std::fixed << " " << gsl_vector_get(vec.m_hnd, i);
         }
         os << ") ";
         return os;
     }
+private:
+    template<typename E>
+    void assign(const VectorExpr<E>& expr){
+        const E&     e      = expr.self();
+        double*      out    = m_hnd->data;
+        const size_t stride = m_hnd->stride;
+        const size_t n      = m_size;
+        // Unit stride loop can be vectorized by the compiler 
+        if(stride == 1)
+            for(size_t i = 0; i < n; i++)
+                out[i] = e.eval(i);
+        else
+            for(size_t i = 0; i < n; i++)
+                out[i * stride] = e.eval(i);
+    }
 };
 
+template<typename L, typename R>
+BinaryExpr<L, R, OpAdd> operator+(const VectorExpr<L>& lhs, const VectorExpr<R>& rhs){
+    return BinaryExpr<L, R, OpAdd>(lhs.self(), rhs.self());
+}
+
+template<typename L, typename R>
+BinaryExpr<L, R, OpSub> operator-(const VectorExpr<L>& lhs, const VectorExpr<R>& rhs){
+    return BinaryExpr<L, R, OpSub>(lhs.self(), rhs.self());
+}
+
+/// Element-wise product (Hadamard product)
+template<typename L, typename R>
+BinaryExpr<L, R, OpMul> mul(const VectorExpr<L>& lhs, const VectorExpr<R>& rhs){
+    return BinaryExpr<L, R, OpMul>(lhs.self(), rhs.self());
+}
+
+template<typename E>
+ScalarExpr<E, OpMul> operator*(const VectorExpr<E>& expr, double x){
+    return ScalarExpr<E, OpMul>(expr.self(), x);
+}
+
+template<typename E>
+ScalarExpr<E, OpMul> operator*(double x, const VectorExpr<E>& expr){
+    return ScalarExpr<E, OpMul>(expr.self(), x);
+}
+
+template<typename E>
+ScalarExpr<E, OpAdd> operator+(const VectorExpr<E>& expr, double x){
+    return ScalarExpr<E, OpAdd>(expr.self(), x);
+}
+
+/// Printing an expression evaluates it into a temporary vector.
+template<typename E>
+std::ostream& operator<<(std::ostream& os, const VectorExpr<E>& expr){
+    return os << GSLVector(expr);
+}
+
+/** Non-owning strided view of a matrix row or column. No data is copied,
+ *  the element (i) is located at data[i * stride].
+ */
+struct GSLSpan{
+    double* data;
+    size_t  size;
+    size_t  stride;
+    GSLSpan(double* data, size_t size, size_t stride)
+        : data(data), size(size), stride(stride) {}
+    double& operator[](size_t i) const { return data[i * stride]; }
+    /// View as gsl_vector for passing to GSL functions
+    gsl_vector_view view() const {
+        return gsl_vector_view_array_with_stride(data, stride, size);
+    }
+    double sum() const {
+        double acc = 0.0;
+        for(size_t i = 0; i < size; i++) acc += data[i * stride];
+        return acc;
+    }
+};
+
+/** Common functionality of GSLMatrix (owning) and GSLMatrixView (non-owning).
+ *  Elements are accessed directly through the row-major buffer with leading
+ *  dimension tda, instead of gsl_matrix_get/gsl_matrix_set function calls.
+ */
+class GSLMatrixBase{
+protected:
+    gsl_matrix* m_hnd = nullptr;
+public:
+    size_t rows() const { return m_hnd->size1; }
+    size_t cols() const { return m_hnd->size2; }
+    gsl_matrix*       data()       { return m_hnd; }
+    const gsl_matrix* data() const { return m_hnd; }
+
+    double& operator()(size_t i, size_t j){
+        return m_hnd->data[i * m_hnd->tda + j];
+    }
+    double operator()(size_t i, size_t j) const {
+        return m_hnd->data[i * m_hnd->tda + j];
+    }
+    GSLSpan row(size_t i) const {
+        return GSLSpan(m_hnd->data + i * m_hnd->tda, m_hnd->size2, 1);
+    }
+    GSLSpan col(size_t j) const {
+        return GSLSpan(m_hnd->data + j, m_hnd->size1, m_hnd->tda);
+    }
+    void fill(double x){
+        gsl_matrix_set_all(m_hnd, x);
+    }
+    friend std::ostream& operator<<(std::ostream& os, const GSLMatrixBase& m){
+        os << "[" << m.rows() << " x " << m.cols() << "]\n";
+        for(size_t i = 0; i < m.rows(); i++){
+            for(size_t j = 0; j < m.cols(); j++)
+                os << std::setprecision(4) << std::fixed << std::setw(10) << m(i, j);
+            os << "\n";
+        }
+        return os;
+    }
+};
+
+/// Non-owning view of a sub-matrix, modifications change the parent matrix.
+class GSLMatrixView: public GSLMatrixBase{
+private:
+    gsl_matrix_view m_view;
+public:
+    GSLMatrixView(gsl_matrix* parent, size_t i, size_t j, size_t nrows, size_t ncols)
+        : m_view(gsl_matrix_submatrix(parent, i, j, nrows, ncols)){
+        m_hnd = &m_view.matrix;
+    }
+    GSLMatrixView(const GSLMatrixView& src): m_view(src.m_view){
+        m_hnd = &m_view.matrix;
+    }
+    GSLMatrixView& operator=(const GSLMatrixView&) = delete;
+};
+
+class GSLMatrix: public GSLMatrixBase{
+public:
+    GSLMatrix(size_t rows, size_t cols){
+        m_hnd = gsl_matrix_alloc(rows, cols);
+    }
+    GSLMatrix(size_t rows, size_t cols, double x){
+        m_hnd = gsl_matrix_alloc(rows, cols);
+        gsl_matrix_set_all(m_hnd, x);
+    }
+    // Copy constructor - copies only the elements of a view. 
+    GSLMatrix(const GSLMatrixBase& src){
+        m_hnd = gsl_matrix_alloc(src.rows(), src.cols());
+        gsl_matrix_memcpy(m_hnd, src.data());
+    }
+    GSLMatrix(const GSLMatrix& src): GSLMatrix(static_cast<const GSLMatrixBase&>(src)){}
+    GSLMatrix(GSLMatrix&& src) noexcept {
+        std::swap(m_hnd, src.m_hnd);
+    }
+    GSLMatrix& operator=(GSLMatrix src) noexcept {
+        std::swap(m_hnd, src.m_hnd);
+        return *this;
+    }
+    ~GSLMatrix(){
+        if(m_hnd != nullptr)
+            gsl_matrix_free(m_hnd);
+    }
+    static GSLMatrix identity(size_t n){
+        GSLMatrix m(n, n);
+        gsl_matrix_set_identity(m.data());
+        return m;
+    }
+    GSLMatrixView view(size_t i, size_t j, size_t nrows, size_t ncols){
+        return GSLMatrixView(m_hnd, i, j, nrows, ncols);
+    }
+};
+
+/// Matrix-vector product y = A * x dispatched to BLAS dgemv
+inline GSLVector operator*(const GSLMatrixBase& A, const GSLVector& x){
+    if(A.cols() != x.size())
+        throw std::invalid_argument("Matrix and vector sizes mismatch");
+    GSLVector y(A.rows());
+    gsl_blas_dgemv(CblasNoTrans, 1.0, A.data(), x.data(), 0.0, y.data());
+    return y;
+}
+
+/// Matrix-matrix product C = A * B dispatched to BLAS dgemm
+inline GSLMatrix operator*(const GSLMatrixBase& A, const GSLMatrixBase& B){
+    if(A.cols() != B.rows())
+        throw std::invalid_argument("Matrix sizes mismatch");
+    GSLMatrix C(A.rows(), B.cols());
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, A.data(), B.data(), 0.0, C.data());
+    return C;
+}
+
+/** Cache-blocked matrix product C = A * B, fallback for when an optimized
+ *  BLAS is not available (the reference gslcblas is not blocked).
+ *  The matrices are split into blockSize x blockSize tiles, so that
+ *  tiles of A, B and C fit in the L1/L2 cache while they are reused.
+ *  The inner loop (i, k, j order) accesses B and C rows with unit stride
+ *  and can be vectorized by the compiler.
+ */
+inline void multiplyBlocked(const GSLMatrixBase& A, const GSLMatrixBase& B
+                            , GSLMatrixBase& C, size_t blockSize = 64){
+    if(A.cols() != B.rows() || C.rows() != A.rows() || C.cols() != B.cols())
+        throw std::invalid_argument("Matrix sizes mismatch");
+    const size_t n = A.rows(), m = A.cols(), p = B.cols();
+    const double* a = A.data()->data;
+    const double* b = B.data()->data;
+    double*       c = C.data()->data;
+    const size_t lda = A.data()->tda, ldb = B.data()->tda, ldc = C.data()->tda;
+    for(size_t i = 0; i < n; i++)
+        for(size_t j = 0; j < p; j++)
+            c[i * ldc + j] = 0.0;
+    for(size_t ii = 0; ii < n; ii += blockSize)
+        for(size_t kk = 0; kk < m; kk += blockSize)
+            for(size_t jj = 0; jj < p; jj += blockSize){
+                const size_t iend = std::min(ii + blockSize, n);
+                const size_t kend = std::min(kk + blockSize, m);
+                const size_t jend = std::min(jj + blockSize, p);
+                for(size_t i = ii; i < iend; i++)
+                    for(size_t k = kk; k < kend; k++){
+                        const double aik  = a[i * lda + k];
+                        const double* brow = b + k * ldb;
+                        double*       crow = c + i * ldc;
+                        for(size_t j = jj; j < jend; j++)
+                            crow[j] += aik * brow[j];
+                    }
+            }
+}
+
 int main(){
 	GSLVector vec1(5, 2.45);
 	vec1.set(0, -3.45);
@@ -145,6 +448,88 @@ int main(){
 	GSLVector vec3 = vec1 + vec2;
 	std::cout << "vec3 = " << vec3 << "\n";
 	std::cout << "vec1 * 3 + vec2 * 2.5 = " << vec1 * 1.5 + vec2 * 2.5 << "\n";
+
+	// The expression is evaluated in a single pass and only the
+	// result vector is allocated.
+	GSLVector vec4 = vec1 * 1.5 + vec2 * 2.5 - mul(vec1, vec2);
+	std::cout << "vec4 = " << vec4 << "\n";
+	// Reuses the buffer of vec4 
+	vec4 = vec4 * 2.0 + 1.0;
+	std::cout << "vec4 = " << vec4 << "\n";
+
+	// Move constructor: no copy 
+	GSLVector vec5 = std::move(vec4);
+	std::cout << "vec5 = " << vec5 << "\n";
+
+	std::puts("\n ==== Benchmark: a * 1.5 + b * 2.5 - c (N = 10,000,000) ====");
+	using Clock = std::chrono::steady_clock;
+	const int N = 10000000;
+	GSLVector a(N, 1.0), b(N, 2.0), c(N, 3.0), r(N);
+	auto t0 = Clock::now();
+	{   // Eager evaluation with GSL functions: 3 temporaries and 4 passes. 
+		GSLVector ta = a, tb = b;
+		gsl_vector_scale(ta.data(), 1.5);
+		gsl_vector_scale(tb.data(), 2.5);
+		gsl_vector_add(ta.data(), tb.data());
+		gsl_vector_sub(ta.data(), c.data());
+		r = std::move(ta);
+	}
+	auto t1 = Clock::now();
+	// Fused evaluation: no temporaries and 1 pass.
+	r = a * 1.5 + b * 2.5 - c;
+	auto t2 = Clock::now();
+	auto ms = [](Clock::duration d){
+		return std::chrono::duration<double, std::milli>(d).count();
+	};
+	std::cout << " Eager (GSL functions) = " << ms(t1 - t0) << " ms" << "\n";
+	std::cout << " Expression templates  = " << ms(t2 - t1) << " ms" << "\n";
+	std::cout << " r.max() = " << r.max() << " ; r.min() = " << r.min() << "\n";
+
+	std::puts("\n ==== GSLMatrix ====");
+	GSLMatrix m1(3, 3);
+	for(size_t i = 0; i < m1.rows(); i++)
+		for(size_t j = 0; j < m1.cols(); j++)
+			m1(i, j) = i * 3.0 + j;
+	std::cout << "m1 = " << m1 << "\n";
+	std::cout << "sum(m1.row(1)) = " << m1.row(1).sum() << "\n";
+	std::cout << "sum(m1.col(2)) = " << m1.col(2).sum() << "\n";
+	// Sub-matrix view: modifies m1 
+	GSLMatrixView sub = m1.view(1, 1, 2, 2);
+	sub.fill(-1.0);
+	std::cout << "m1 = " << m1 << "\n";
+	GSLVector x(3, 1.0);
+	std::cout << "m1 * x = " << m1 * x << "\n";
+	std::cout << "m1 * I = " << m1 * GSLMatrix::identity(3) << "\n";
+
+	std::puts("\n ==== Benchmark: matrix product C = A * B (512 x 512) ====");
+	const size_t M = 512;
+	GSLMatrix A(M, M), B(M, M), C1(M, M), C2(M, M), C3(M, M);
+	for(size_t i = 0; i < M; i++)
+		for(size_t j = 0; j < M; j++){
+			A(i, j) = std::sin(i + 2.0 * j);
+			B(i, j) = std::cos(2.0 * i - j);
+		}
+	t0 = Clock::now();
+	for(size_t i = 0; i < M; i++)
+		for(size_t j = 0; j < M; j++){
+			double acc = 0.0;
+			for(size_t k = 0; k < M; k++)
+				acc += gsl_matrix_get(A.data(), i, k) * gsl_matrix_get(B.data(), k, j);
+			gsl_matrix_set(C1.data(), i, j, acc);
+		}
+	t1 = Clock::now();
+	gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, A.data(), B.data(), 0.0, C2.data());
+	t2 = Clock::now();
+	multiplyBlocked(A, B, C3);
+	auto t3 = Clock::now();
+	std::cout << " Element-wise (gsl_matrix_get) = " << ms(t1 - t0) << " ms" << "\n";
+	std::cout << " BLAS gsl_blas_dgemm          = " << ms(t2 - t1) << " ms" << "\n";
+	std::cout << " Cache-blocked kernel         = " << ms(t3 - t2) << " ms" << "\n";
+	double maxdiff = 0.0;
+	for(size_t i = 0; i < M; i++)
+		for(size_t j = 0; j < M; j++)
+			maxdiff = std::max(maxdiff, std::fabs(C2(i, j) - C3(i, j)));
+	std::cout << " max|C_blas - C_blocked| = " << std::scientific << maxdiff << "\n";
 	
 	return 0;
 }
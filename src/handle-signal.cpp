@@ -1,16 +1,29 @@
 // Author: Caio Rodrigues
 // Brief:  Test signal handling in C++.
+//
+// Signals are handled synchronously with Linux signalfd(): the signals are
+// blocked and read from a file descriptor as ordinary data, so handlers run
+// in the event loop (epoll) as normal functions instead of asynchronous
+// signal handlers. Unlike a classic handler installed with std::signal(),
+// they can safely use std::map, std::cerr or allocate memory.
+//
+// Compile with:
+// $ clang++ handle-signal.cpp -o handle-signal.bin -std=c++1z -g -O0 -Wall
 //-------------------------------------------------
 
 #include <iostream>
-#include <map>
 #include <string>
-#include <functional> 
+#include <functional>
 #include <csignal>
-#include <fstream> 
+#include <cstring>
+#include <cerrno>
+#include <array>
 
 // Unix specific (not valid for MS-Windows)
 #include <unistd.h> // Import getpid()
+// Linux specific
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
 
 
 class Dummy{
@@ -25,68 +38,189 @@ public:
 
 Dummy dummyGlobal;
 
-void signal_handler(int signal)
-{
-	// static auto logger = []{
-	// 	auto log = std::ofstream("signals.log");
-	// 	log << " [INFO] Initialized Logger OK." << std::endl;
-	// 	return log;	
-	// }();
-
-	auto& logger = std::cerr;
-	
-	const static std::map<int, std::string> signalDatabse = {
-		 {SIGINT,   "SIGINT"}
-		,{SIGABRT,  "SIGABRT"}
-		,{SIGSEGV,  "SIGSEV"}
-		,{SIGFPE,   "SIGFPE"}
-		,{SIGTSTP,  "SIGTSTP"}
-		,{SIGTERM,  "SIGTERM"}
-		,{SIGQUIT,  "SIGQUIT"}
-	  };
-
-	// std::cin.ignore(1000);
-	std::cin.clear();
-	
-	std::string sigName;
-	
-	auto it = signalDatabse.find(signal);
-	if(it != signalDatabse.end())
-		sigName = it->second;
-	else
-		sigName = "UNKNOWN";
-
-	logger << "\n [INFO] " << __FUNCTION__ << "() "
-		   << " Received singal = {" << sigName << "} => code = " << signal << std::endl;
-}
+/** Dispatch signals read from a signalfd to handlers registered by signal number.
+ *
+ *  Usage:
+ *   + Register handlers with on() before any thread is created, as the
+ *     signals must be blocked in all threads, otherwise they would be
+ *     delivered the classic way to a thread which does not block them.
+ *   + Add fd() to an epoll/poll/select loop and call dispatch() when
+ *     it is readable.
+ *
+ *  Dispatching does not allocate memory, handlers are stored in a fixed
+ *  size table indexed by the signal number.
+ *
+ *  Note: synchronous signals caused by the faulting instruction, such as
+ *  SIGSEGV, SIGFPE, SIGBUS or SIGILL, cannot be handled with signalfd.
+ */
+class SignalDispatcher{
+public:
+	using Handler = std::function<void (const signalfd_siginfo&)>;
+
+	SignalDispatcher(){
+		sigemptyset(&m_mask);
+		// Save the current mask, restored by the destructor
+		::sigprocmask(SIG_BLOCK, nullptr, &m_oldmask);
+	}
+	/// Signals still pending are discarded, otherwise those whose default
+	/// action is to terminate would kill the process as soon as they are
+	/// unblocked.
+	~SignalDispatcher(){
+		if(m_fd >= 0){
+			signalfd_siginfo info;
+			while(::read(m_fd, &info, sizeof(info)) == sizeof(info)) { }
+			::close(m_fd);
+		}
+		::sigprocmask(SIG_SETMASK, &m_oldmask, nullptr);
+	}
+	SignalDispatcher(const SignalDispatcher&) = delete;
+	SignalDispatcher& operator= (const SignalDispatcher&) = delete;
+
+	/// Register handler for the signal, replacing the previous one.
+	/// Returns false if the signal cannot be handled.
+	auto on(int signum, Handler handler) -> bool {
+		if(signum <= 0 || signum >= static_cast<int>(m_handlers.size()))
+			return false;
+		if(signum == SIGSEGV || signum == SIGFPE || signum == SIGBUS || signum == SIGILL
+		   || signum == SIGKILL || signum == SIGSTOP)
+			return false;
+		// The state is only changed on success
+		sigset_t mask = m_mask;
+		sigaddset(&mask, signum);
+		if(::sigprocmask(SIG_BLOCK, &mask, nullptr) < 0)
+			return false;
+		// Updates the set of signals of an existing signalfd
+		int fd = ::signalfd(m_fd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if(fd < 0){
+			// Unblock the signal again, unless it was already blocked
+			if(!sigismember(&m_mask, signum) && !sigismember(&m_oldmask, signum)){
+				sigset_t added;
+				sigemptyset(&added);
+				sigaddset(&added, signum);
+				::sigprocmask(SIG_UNBLOCK, &added, nullptr);
+			}
+			return false;
+		}
+		m_fd   = fd;
+		m_mask = mask;
+		m_handlers[signum] = std::move(handler);
+		return true;
+	}
+
+	/// File descriptor to be monitored for reading
+	auto fd() const -> int { return m_fd; }
+
+	/// Read all pending signals and call their handlers. Returns the number
+	/// of signals dispatched or -1 on error.
+	auto dispatch() -> int {
+		// Several signals are read with a single system call
+		std::array<signalfd_siginfo, 16> infos;
+		int count = 0;
+		for(;;){
+			ssize_t n = ::read(m_fd, infos.data(), sizeof(infos));
+			if(n < 0)
+				return (errno == EAGAIN || errno == EINTR) ? count : -1;
+			size_t k = static_cast<size_t>(n) / sizeof(signalfd_siginfo);
+			for(size_t i = 0; i < k; i++){
+				const Handler& h = m_handlers[infos[i].ssi_signo];
+				if(h) h(infos[i]);
+				count++;
+			}
+			if(k < infos.size())
+				return count;
+		}
+	}
+
+private:
+	int                       m_fd = -1;
+	sigset_t                  m_mask;
+	sigset_t                  m_oldmask;
+	std::array<Handler, NSIG> m_handlers;
+};
 
 int main()
 {
 	pid_t pid = ::getpid();
 	std::cout << " Process ID =  " << pid << "\n";
 	std::cout << " Attach to it with $ gdb --tui --pid=" << pid << "\n";
-	
-	std::signal(SIGINT,  &signal_handler);
-	std::signal(SIGFPE,  &signal_handler);
-	std::signal(SIGTERM,  signal_handler);
-	std::signal(SIGTSTP,  signal_handler);
-	std::signal(SIGQUIT,  signal_handler);
-	
+	std::cout << " Send signals with $ kill -INT " << pid << " ; kill -TERM " << pid << "\n";
+
+	bool running = true;
+	SignalDispatcher signals;
+
+	auto logSignal = [](const signalfd_siginfo& info){
+		std::cerr << "\n [INFO] Received signal = {" << ::strsignal(info.ssi_signo) << "}"
+				  << " => code = " << info.ssi_signo
+				  << " ; sender PID = " << info.ssi_pid << std::endl;
+	};
+	signals.on(SIGINT,  logSignal);
+	signals.on(SIGTSTP, logSignal);
+	signals.on(SIGHUP,  logSignal);
+	// Graceful shutdown: the destructors of all objects are called
+	signals.on(SIGTERM, [&](const signalfd_siginfo& info){
+		logSignal(info);
+		running = false;
+	});
+	signals.on(SIGQUIT, [&](const signalfd_siginfo& info){
+		logSignal(info);
+		running = false;
+	});
+
+	int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event ev;
+	ev.events  = EPOLLIN;
+	ev.data.fd = signals.fd();
+	if(epfd < 0 || ::epoll_ctl(epfd, EPOLL_CTL_ADD, signals.fd(), &ev) < 0){
+		std::cerr << " [ERROR] epoll: " << ::strerror(errno) << "\n";
+		return EXIT_FAILURE;
+	}
+	// Regular files and /dev/null cannot be added to epoll (EPERM), they
+	// are always readable, so stdin is then read on every iteration.
+	ev.data.fd = STDIN_FILENO;
+	bool stdinPolled = ::epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0;
+	if(!stdinPolled && errno != EPERM){
+		std::cerr << " [ERROR] epoll: " << ::strerror(errno) << "\n";
+		::close(epfd);
+		return EXIT_FAILURE;
+	}
+
 	int n = 0;
-	char ch = 0;
-
-	std::string line;
-	
-	while(std::cin.good()){
-		std::cout << " Variable n = " << n++ << "\n";
-		std::cout << " => Input = ";
-		std::getline(std::cin, line);
-		
-		// Simulate float-point exception 
-		if(line == "sigfpe"){
-			std::cout << " 10.0 / 0.0 = " << 10.0 / 0.0 << "\n";
+	std::string buffer;
+	std::cout << " Variable n = " << n++ << "\n";
+	std::cout << " => Input = " << std::flush;
+
+	// Returns false at the end of input (Ctrl + D)
+	auto readInput = [&]{
+		char chunk[512];
+		ssize_t k = ::read(STDIN_FILENO, chunk, sizeof(chunk));
+		if(k <= 0)
+			return false;
+		buffer.append(chunk, k);
+		size_t pos;
+		while((pos = buffer.find('\n')) != std::string::npos){
+			std::string line = buffer.substr(0, pos);
+			buffer.erase(0, pos + 1);
+			std::cout << " Line = " << line << "\n";
+			std::cout << " Variable n = " << n++ << "\n";
+			std::cout << " => Input = " << std::flush;
 		}
+		return true;
+	};
+
+	while(running){
+		struct epoll_event events[4];
+		int nev = ::epoll_wait(epfd, events, 4, stdinPolled ? -1 : 0);
+		if(nev < 0 && errno != EINTR) break;
+		for(int i = 0; i < nev; i++){
+			if(events[i].data.fd == signals.fd())
+				signals.dispatch();
+			else if(!readInput())
+				running = false;
+		}
+		if(running && !stdinPolled && !readInput())
+			running = false;
 	}
-	
+	::close(epfd);
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,161 @@
+// File:   inplace-function.hpp
+// Brief:  Allocation-free replacements for std::function on hot paths.
+// Author: Caio Rodrigues
+//
+//  + inplace_function<R (Args...), Capacity> - owning, copyable callable
+//    wrapper like std::function, but the callable is always stored in an
+//    internal buffer of Capacity bytes. It never allocates memory: callables
+//    which do not fit are rejected at compile time.
+//
+//  + function_ref<R (Args...)> - non-owning reference to a callable (two
+//    pointers), intended for function parameters. The referenced callable
+//    must outlive the function_ref.
+//
+//  Both dispatch through a single function pointer instead of the virtual
+//  call of std::function's type erasure.
+//-------------------------------------------------------------------------
+#ifndef _INPLACE_FUNCTION_HPP_
+#define _INPLACE_FUNCTION_HPP_
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <utility>
+#include <functional>   // std::bad_function_call
+#include <type_traits>
+
+template<typename Signature, size_t Capacity = 32>
+class inplace_function;
+
+template<typename R, typename... Args, size_t Capacity>
+class inplace_function<R (Args...), Capacity>
+{
+public:
+	inplace_function() noexcept = default;
+	inplace_function(std::nullptr_t) noexcept { }
+
+	template<typename F,
+			 typename Fn = std::decay_t<F>,
+			 typename = std::enable_if_t<!std::is_same<Fn, inplace_function>::value
+										 && std::is_invocable_r<R, Fn&, Args...>::value>>
+	inplace_function(F&& fn)
+	{
+		static_assert(sizeof(Fn) <= Capacity,
+					  "Callable too large for inplace_function, increase Capacity");
+		static_assert(alignof(Fn) <= alignof(std::max_align_t),
+					  "Callable alignment not supported");
+		static_assert(std::is_copy_constructible<Fn>::value,
+					  "inplace_function requires copyable callables");
+		static_assert(std::is_nothrow_move_constructible<Fn>::value,
+					  "inplace_function requires nothrow movable callables");
+		new (&m_storage) Fn(std::forward<F>(fn));
+		m_vtable = &vtableFor<Fn>;
+	}
+
+	inplace_function(const inplace_function& rhs)
+		: m_vtable(rhs.m_vtable)
+	{
+		if(m_vtable) m_vtable->copy(&m_storage, &rhs.m_storage);
+	}
+	inplace_function(inplace_function&& rhs) noexcept
+		: m_vtable(rhs.m_vtable)
+	{
+		if(m_vtable) m_vtable->move(&m_storage, &rhs.m_storage);
+	}
+	auto operator=(const inplace_function& rhs) -> inplace_function& {
+		if(this != &rhs){
+			inplace_function tmp(rhs);
+			*this = std::move(tmp);
+		}
+		return *this;
+	}
+	auto operator=(inplace_function&& rhs) noexcept -> inplace_function& {
+		if(this != &rhs){
+			this->reset();
+			m_vtable = rhs.m_vtable;
+			if(m_vtable) m_vtable->move(&m_storage, &rhs.m_storage);
+		}
+		return *this;
+	}
+	~inplace_function(){ this->reset(); }
+
+	explicit operator bool() const noexcept { return m_vtable != nullptr; }
+
+	/// Throws std::bad_function_call if empty, like std::function.
+	auto operator()(Args... args) const -> R {
+		if(m_vtable == nullptr)
+			throw std::bad_function_call();
+		return m_vtable->invoke(&m_storage, std::forward<Args>(args)...);
+	}
+
+private:
+	struct VTable{
+		R    (* invoke)(void* obj, Args&&... args);
+		void (* copy)(void* dst, const void* src);
+		void (* move)(void* dst, void* src) noexcept;
+		void (* destroy)(void* obj) noexcept;
+	};
+
+	template<typename Fn>
+	static constexpr VTable vtableFor = {
+		[](void* obj, Args&&... args) -> R {
+			return std::invoke(*static_cast<Fn*>(obj), std::forward<Args>(args)...);
+		},
+		[](void* dst, const void* src){
+			new (dst) Fn(*static_cast<const Fn*>(src));
+		},
+		// The moved-from object is destroyed later by its owner
+		[](void* dst, void* src) noexcept {
+			new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+		},
+		[](void* obj) noexcept {
+			static_cast<Fn*>(obj)->~Fn();
+		}
+	};
+
+	void reset() noexcept {
+		if(m_vtable) m_vtable->destroy(&m_storage);
+		m_vtable = nullptr;
+	}
+
+	mutable std::aligned_storage_t<Capacity, alignof(std::max_align_t)> m_storage;
+	const VTable* m_vtable = nullptr;
+};
+
+template<typename Signature>
+class function_ref;
+
+template<typename R, typename... Args>
+class function_ref<R (Args...)>
+{
+public:
+	template<typename F,
+			 typename = std::enable_if_t<!std::is_same<std::decay_t<F>, function_ref>::value
+										 && std::is_invocable_r<R, F&, Args...>::value>>
+	function_ref(F&& fn) noexcept
+	{
+		using Fn = std::remove_reference_t<F>;
+		if constexpr(std::is_function<Fn>::value){
+			// Plain functions: store the function pointer itself
+			m_obj = reinterpret_cast<void*>(&fn);
+			m_callback = [](void* obj, Args... args) -> R {
+				return std::invoke(reinterpret_cast<Fn*>(obj), std::forward<Args>(args)...);
+			};
+		} else {
+			m_obj = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+			m_callback = [](void* obj, Args... args) -> R {
+				return std::invoke(*static_cast<Fn*>(obj), std::forward<Args>(args)...);
+			};
+		}
+	}
+
+	auto operator()(Args... args) const -> R {
+		return m_callback(m_obj, std::forward<Args>(args)...);
+	}
+
+private:
+	void* m_obj;
+	R  (* m_callback)(void* obj, Args... args);
+};
+
+#endif
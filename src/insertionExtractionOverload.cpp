@@ -3,6 +3,23 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+#include <charconv>
+#include <stdexcept>
+#include <thread>
+#include <exception>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+// Unix specific (memory mapped files)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define DBG_DISP(expr)  std::cerr << __FILE__ << ":" << __LINE__ << ":" \
 	<< " ; " <<  #expr << " = " << (expr)  <<  std::endl
@@ -29,6 +46,31 @@ public:
 	auto operator>>(std::istream& is, Product& prod) -> std::istream&;	
 };
 
+// === file: ProductReader.hpp - bulk parser interface ====//
+
+/** Bulk parser for the text format written by operator<< for Product,
+ *  one product per line:  <id> "<name>" <price>
+ *
+ *  Instead of extracting one field at a time from an std::istream, the
+ *  whole buffer is parsed in place: lines are found with memchr()
+ *  (vectorized in glibc) and numbers are parsed with std::from_chars,
+ *  which is locale independent. Large buffers are split at line
+ *  boundaries into chunks parsed in parallel.
+ *
+ *  Note: names must not contain line breaks.
+ */
+namespace ProductReader{
+	/** Parse single line, throws std::runtime_error if it is malformed. */
+	auto parseLine(std::string_view line) -> Product;
+
+	/** Parse all products of the buffer using nthreads threads (0 means
+	 *  hardware concurrency). Empty lines are ignored. */
+	auto parse(std::string_view text, unsigned nthreads = 1) -> std::vector<Product>;
+
+	/** Memory map the file and parse it in parallel. */
+	auto readFile(const std::string& path, unsigned nthreads = 0) -> std::vector<Product>;
+}
+
 // === file: main.cpp ==================================//
 
 int main(){
@@ -55,7 +97,55 @@ int main(){
 	ss >> pr;
 	std::cout << " pr3 = " << pr << std::endl;
 
-	std::puts(" >>> EXPERIMENT 4 == Read products from console ====");
+	std::puts(" >>> EXPERIMENT 4 == Bulk parsing of product catalogue ====");
+	{
+		std::stringstream catalogue;
+		const int nproducts = 2000000;
+		for(int i = 0; i < nproducts; i++)
+			catalogue << Product(i, "Product \"" + std::to_string(i % 1000) + "\" 1kg", 0.25 * (i % 400)) << "\n";
+		const std::string text = catalogue.str();
+		using clock = std::chrono::steady_clock;
+		auto ms = [](auto d){ return std::chrono::duration<double, std::milli>(d).count(); };
+
+		auto t0 = clock::now();
+		std::vector<Product> xs;
+		Product p;
+		std::stringstream is(text);
+		while(is >> p)
+			xs.push_back(p);
+		auto t1 = clock::now();
+		auto ys = ProductReader::parse(text, 1);
+		auto t2 = clock::now();
+		auto zs = ProductReader::parse(text, 0);
+		auto t3 = clock::now();
+
+		// Same catalogue written to a temporary file and memory mapped
+		char path[] = "/tmp/products-XXXXXX";
+		int fd = ::mkstemp(path);
+		if(fd < 0)
+			throw std::runtime_error("Error: cannot create temporary file");
+		::close(fd);
+		std::ofstream(path, std::ios::binary) << text;
+		auto t4 = clock::now();
+		auto ws = ProductReader::readFile(path);
+		auto t5 = clock::now();
+		::unlink(path);
+
+		double mb = text.size() / 1e6;
+		std::cout << " Catalogue = " << nproducts << " products ; " << mb << " MB" << "\n";
+		std::cout << " operator>>             = " << ms(t1 - t0) << " ms ; "
+				  << mb / (ms(t1 - t0) / 1000) << " MB/s ; n = " << xs.size() << "\n";
+		std::cout << " ProductReader (serial) = " << ms(t2 - t1) << " ms ; "
+				  << mb / (ms(t2 - t1) / 1000) << " MB/s ; n = " << ys.size() << "\n";
+		std::cout << " ProductReader (" << std::thread::hardware_concurrency() << " threads) = "
+				  << ms(t3 - t2) << " ms ; " << mb / (ms(t3 - t2) / 1000) << " MB/s ; n = " << zs.size() << "\n";
+		std::cout << " ProductReader::readFile = " << ms(t5 - t4) << " ms ; "
+				  << mb / (ms(t5 - t4) / 1000) << " MB/s ; n = " << ws.size() << "\n";
+		std::cout << " Last product = " << zs.back() << "\n";
+		std::cout << " Last product (file) = " << ws.back() << "\n";
+	}
+
+	std::puts(" >>> EXPERIMENT 5 == Read products from console ====");
 	Product prod;
 	while(!std::cin.eof()){
 		std::cout << "Enter product: ";
@@ -90,7 +180,7 @@ void Product::showProduct() const
 
 int Product::Id() const
 {
-	return m_price;
+	return m_id;
 }
 
 std::string Product::Name() const
@@ -115,3 +205,146 @@ auto operator>>(std::istream& is, Product& prod) -> std::istream&
 {
 	return is >> prod.m_id >> std::quoted(prod.m_name) >> prod.m_price;	
 }
+
+// ==== file: ProductReader.cpp - Implementation ===============//
+
+namespace ProductReader{
+	namespace {
+		[[noreturn]] void parseError(std::string_view line, const char* what)
+		{
+			throw std::runtime_error(std::string("Error: ") + what + " in line: " + std::string(line));
+		}
+		auto skipSpaces(const char* p, const char* end) -> const char*
+		{
+			while(p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+				p++;
+			return p;
+		}
+		// Parse products of the lines in [first, last) into out
+		void parseChunk(const char* first, const char* last, std::vector<Product>& out)
+		{
+			while(first < last){
+				auto nl  = static_cast<const char*>(std::memchr(first, '\n', last - first));
+				auto eol = nl != nullptr ? nl : last;
+				auto line = std::string_view(first, eol - first);
+				if(skipSpaces(line.data(), eol) != eol)
+					out.push_back(parseLine(line));
+				first = nl != nullptr ? nl + 1 : last;
+			}
+		}
+	}
+
+	auto parseLine(std::string_view line) -> Product
+	{
+		const char* p   = line.data();
+		const char* end = p + line.size();
+		int id;
+		p = skipSpaces(p, end);
+		auto r1 = std::from_chars(p, end, id);
+		if(r1.ec != std::errc())
+			parseError(line, "invalid id");
+		p = skipSpaces(r1.ptr, end);
+		// Name quoted like std::quoted: '\' escapes '"' and '\'
+		if(p == end || *p != '"')
+			parseError(line, "expected quoted name");
+		std::string name;
+		for(p++; ; p++){
+			if(p == end)
+				parseError(line, "unterminated name");
+			if(*p == '"')
+				break;
+			if(*p == '\\' && p + 1 != end)
+				p++;
+			name.push_back(*p);
+		}
+		p = skipSpaces(p + 1, end);
+		double price;
+		auto r2 = std::from_chars(p, end, price);
+		if(r2.ec != std::errc())
+			parseError(line, "invalid price");
+		if(skipSpaces(r2.ptr, end) != end)
+			parseError(line, "unexpected trailing characters");
+		return Product(id, name, price);
+	}
+
+	auto parse(std::string_view text, unsigned nthreads) -> std::vector<Product>
+	{
+		if(nthreads == 0)
+			nthreads = std::max(1u, std::thread::hardware_concurrency());
+		// Small inputs are not worth the thread creation
+		const size_t minChunk = 1 << 20;
+		nthreads = static_cast<unsigned>(std::min<size_t>(nthreads, text.size() / minChunk + 1));
+
+		const char* begin = text.data();
+		const char* end   = begin + text.size();
+		// Chunk boundaries are moved forward to the next line start
+		std::vector<const char*> bounds{begin};
+		for(unsigned i = 1; i < nthreads; i++){
+			const char* b = begin + text.size() * i / nthreads;
+			b = std::max(b, bounds.back());
+			auto nl = static_cast<const char*>(std::memchr(b, '\n', end - b));
+			bounds.push_back(nl != nullptr ? nl + 1 : end);
+		}
+		bounds.push_back(end);
+
+		std::vector<std::vector<Product>> results(nthreads);
+		std::vector<std::exception_ptr>   errors(nthreads);
+		auto work = [&](unsigned i){
+			try {
+				// Estimate ~32 bytes per record to avoid reallocations
+				results[i].reserve((bounds[i + 1] - bounds[i]) / 32);
+				parseChunk(bounds[i], bounds[i + 1], results[i]);
+			} catch(...) {
+				errors[i] = std::current_exception();
+			}
+		};
+		std::vector<std::thread> threads;
+		for(unsigned i = 1; i < nthreads; i++)
+			threads.emplace_back(work, i);
+		work(0);
+		for(auto& th: threads)
+			th.join();
+		for(auto& e: errors)
+			if(e) std::rethrow_exception(e);
+
+		// Counted before results[0] is moved from
+		size_t total = 0;
+		for(const auto& r: results)
+			total += r.size();
+		std::vector<Product> products = std::move(results[0]);
+		products.reserve(total);
+		for(unsigned i = 1; i < nthreads; i++)
+			std::move(results[i].begin(), results[i].end(), std::back_inserter(products));
+		return products;
+	}
+
+	auto readFile(const std::string& path, unsigned nthreads) -> std::vector<Product>
+	{
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0)
+			throw std::runtime_error("Error: cannot open file " + path);
+		struct stat st;
+		if(::fstat(fd, &st) < 0){
+			::close(fd);
+			throw std::runtime_error("Error: cannot stat file " + path);
+		}
+		size_t size = st.st_size;
+		if(size == 0){
+			::close(fd);
+			return {};
+		}
+		void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(addr == MAP_FAILED)
+			throw std::runtime_error("Error: mmap failed for " + path);
+		::madvise(addr, size, MADV_SEQUENTIAL);
+		try {
+			auto products = parse(std::string_view(static_cast<const char*>(addr), size), nthreads);
+			::munmap(addr, size);
+			return products;
+		} catch(...) {
+			::munmap(addr, size);
+			throw;
+		}
+	}
+}
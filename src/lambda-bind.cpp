@@ -1,8 +1,13 @@
+// Compile with:
+//  $ g++ lambda-bind.cpp -o lambda-bind.bin -std=c++1z -O2 -Wall
 #include <iostream>   // cout, cin, endl
 #include <functional> // Import std::function, bind, placeholders, _1, _2, _3 ... 
 #include <iomanip>    // 
 #include <cmath>      // sin, cos, tan, sqrt ... 
 #include <vector>     // std::vector<X>
+#include <chrono>
+
+#include "inplace-function.hpp"
 
 /*  Debug macro to print expressions - disp(x * 10 + 5) will print 
  *  on cerr (standard error output stream) the line: 
@@ -19,8 +24,10 @@ using Mfun = std::function<double (double)>;
 using NumVector = std::vector<double>;
 
 // ========== Prototypes =============//
-NumVector mapVector(NumVector& xs, Mfun fn);
-NumVector makeVector(int size, std::function<double (int i)>);
+// function_ref: non-owning reference to the function, no allocation and
+// no copy of the callable (see inplace-function.hpp)
+NumVector mapVector(NumVector& xs, function_ref<double (double)> fn);
+NumVector makeVector(int size, function_ref<double (int i)> fn);
 void      tabulate(double start, double stop, double step, Mfun fn);
 double    vectorLength(double x, double y, double z);
 double    sum(double x, double y);
@@ -46,6 +53,64 @@ struct FunctionObject{
     }       
 };
 
+// Versions of mapVector and makeVector taking std::function, for comparison
+NumVector mapVectorStd(NumVector& xs, std::function<double (double)> fn){
+    NumVector ys(xs.size());
+    for(size_t i = 0; i < xs.size(); i++)
+        ys[i] = fn(xs[i]);
+    return ys;
+}
+NumVector makeVectorStd(int size, std::function<double (int i)> fn){
+    NumVector ys(size);
+    for(int i = 0; i < size; i++)
+        ys[i] = fn(i);
+    return ys;
+}
+
+template<typename Function>
+double timeIt(Function fn){
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+void benchmarkFunctions(){
+    const int n = 5000000;
+    // Capture 24 bytes: larger than the small buffer of std::function (16 bytes)
+    double a = 1.5, b = 2.5, c = 0.5;
+    auto poly = [a, b, c](double x){ return (a * x + b) * x + c; };
+    auto gen  = [a, b, c](int i){ return a * i + b * c; };
+    NumVector xs = makeVector(n, [](int i){ return i * 1e-6; });
+
+    double t1 = timeIt([&]{ mapVectorStd(xs, poly); });
+    double t2 = timeIt([&]{ mapVector(xs, poly); });
+    double t3 = timeIt([&]{ makeVectorStd(n, gen); });
+    double t4 = timeIt([&]{ makeVector(n, gen); });
+    std::cout << " mapVector  - std::function  = " << t1 << " ms" << "\n";
+    std::cout << " mapVector  - function_ref   = " << t2 << " ms" << "\n";
+    std::cout << " makeVector - std::function  = " << t3 << " ms" << "\n";
+    std::cout << " makeVector - function_ref   = " << t4 << " ms" << "\n";
+
+    // Stored callbacks: construction and call
+    const int m = 1000000;
+    double sum1 = 0, sum2 = 0;
+    std::vector<std::function<double (double)>> fs;
+    std::vector<inplace_function<double (double)>> gs;
+    fs.reserve(m);
+    gs.reserve(m);
+    double t5 = timeIt([&]{
+        for(int i = 0; i < m; i++) fs.emplace_back([a, b, i](double x){ return a * x + b * i; });
+        for(const auto& f: fs) sum1 += f(1.0);
+    });
+    double t6 = timeIt([&]{
+        for(int i = 0; i < m; i++) gs.emplace_back([a, b, i](double x){ return a * x + b * i; });
+        for(const auto& g: gs) sum2 += g(1.0);
+    });
+    std::cout << " Store and call 1M callbacks - std::function    = " << t5 << " ms (sum = " << sum1 << ")" << "\n";
+    std::cout << " Store and call 1M callbacks - inplace_function = " << t6 << " ms (sum = " << sum2 << ")" << "\n";
+}
+
 int main(){
     using std::cout;
     using std::endl;
@@ -138,11 +203,13 @@ int main(){
     disp(fobj.method2(15.0, 10.0, 14.0));
     disp(method2LambdaAsFnOfAC(15.0, 14.0));
 
+    cout << "======== Test 7 - Benchmark std::function vs function_ref/inplace_function ========" << endl;
+    benchmarkFunctions();
 
 }
  //////////////// Prototypes Implementations ///////////////////////////
 
-NumVector mapVector(NumVector& xs, Mfun fn){
+NumVector mapVector(NumVector& xs, function_ref<double (double)> fn){
     NumVector ys(xs.size());
     int n = xs.size();
     for(int i =0; i < n; i++){
@@ -151,7 +218,7 @@ NumVector mapVector(NumVector& xs, Mfun fn){
     return ys;
 }
 
-NumVector makeVector(int size, std::function<double (int i)> fn){
+NumVector makeVector(int size, function_ref<double (int i)> fn){
     NumVector ys(size);
     for(int i =0; i < size; i++){
         ys[i] = fn(i);
@@ -1,12 +1,24 @@
 //  Description: Proof-of-concept code to show all C++11 lambda capabilities.
 //  Objective :   Show all possible C++11 Lambda variations and use cases in a single-file code.
 //
+//  Compile with:
+//   $ g++ lambdaFun.cpp -o lambdaFun.bin -std=c++1z -O2 -pthread
+//
 #include <iostream>
 #include <functional>  // Provides lambda function types
 #include <vector>
 #include <algorithm> // Import for_each and transform
 #include <string>
 #include <fstream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <stdexcept>
+#include <chrono>
+#include <cstdint>
+
+#include "inplace-function.hpp"
 
 using namespace std;
 
@@ -56,14 +68,18 @@ int foldVector(vector<int> xs, int init, function<int (int, int)> fn){
 //  Example (12) - Observer pattern with observer objects 
 //  replaced by lambda functions
 // 
+//  Observers are stored in inplace_function (see inplace-function.hpp),
+//  which never allocates memory for the captured variables. The effect on
+//  notify() was not measured here, see Test 7 of lambda-bind.cpp.
+//
 class Observable{
 protected:
-        vector<function<void (double)>> observers;
+        vector<inplace_function<void (double)>> observers;
 
 public:
         Observable(){}
 
-        void addObserver(function<void (double)> obs){
+        void addObserver(inplace_function<void (double)> obs){
                 observers.push_back(obs);
         }
 
@@ -74,6 +90,248 @@ public:
         }
 };
 
+//  Example (13) - Concurrent observable (event bus) which can be used
+//  by several threads at the same time.
+//
+//  The list of observers is copy-on-write (RCU - read-copy-update):
+//  notify() reads the current list without taking any lock, while
+//  addObserver()/removeObserver() copy the list, modify the copy, publish
+//  it with an atomic store and free the old list after a grace period,
+//  when no notify() call can still be reading it. Readers announce
+//  themselves in per-shard counters, one set for each parity of the epoch,
+//  so the writer only waits for readers which started before the update.
+//
+//  Observers can be synchronous (called by the thread calling notify) or
+//  asynchronous: each one has a bounded queue consumed by its own thread,
+//  so that slow observers do not slow down producers. Values are dropped
+//  when the queue is full.
+//
+//  Note: observers cannot be added or removed from a synchronous callback,
+//  but an asynchronous observer may remove itself.
+//
+class ConcurrentObservable{
+public:
+        using Token    = uint64_t;
+        using Observer = inplace_function<void (double)>;
+        enum class Delivery { Sync, Async };
+
+        ConcurrentObservable(): m_list(new List) { }
+        ~ConcurrentObservable(){
+                unique_ptr<List> list(m_list.load());
+                for(auto& s: *list)
+                        s->stop();
+        }
+        ConcurrentObservable(const ConcurrentObservable&) = delete;
+        ConcurrentObservable& operator=(const ConcurrentObservable&) = delete;
+
+        auto addObserver(Observer obs, Delivery delivery = Delivery::Sync,
+                         size_t queueCapacity = 4096) -> Token
+        {
+                checkNotInCallback();
+                auto sub = make_shared<Subscriber>(m_nextToken.fetch_add(1), move(obs));
+                if(delivery == Delivery::Async)
+                        sub->startAsync(queueCapacity);
+                try {
+                        this->update([&](List& list){ list.push_back(sub); });
+                } catch(...) {
+                        sub->stop();
+                        throw;
+                }
+                return sub->token;
+        }
+        /// Returns false if there is no observer with this token.
+        auto removeObserver(Token token) -> bool {
+                shared_ptr<Subscriber> removed;
+                this->update([&](List& list){
+                        for(auto it = list.begin(); it != list.end(); ++it)
+                                if((*it)->token == token){
+                                        removed = *it;
+                                        list.erase(it);
+                                        break;
+                                }
+                });
+                // No notify() call can reach it after the grace period
+                if(removed)
+                        removed->stop();
+                return removed != nullptr;
+        }
+        /// Lock-free: may be called by any number of threads.
+        void notify(double value){
+                ReadGuard guard(*this);
+                const List* list = m_list.load(memory_order_seq_cst);
+                for(const auto& s: *list)
+                        s->deliver(value);
+        }
+        auto size() const -> size_t {
+                ReadGuard guard(*this);
+                return m_list.load()->size();
+        }
+        /// Number of values dropped because of full asynchronous queues
+        auto dropped() const -> uint64_t {
+                ReadGuard guard(*this);
+                uint64_t n = 0;
+                for(const auto& s: *m_list.load())
+                        n += s->dropped.load(memory_order_relaxed);
+                return n;
+        }
+
+private:
+        // Bounded multiple-producer queue (Dmitry Vyukov's algorithm)
+        class Queue{
+        public:
+                explicit Queue(size_t capacity){
+                        size_t n = 2;
+                        while(n < capacity) n <<= 1;
+                        m_mask  = n - 1;
+                        m_cells = unique_ptr<Cell[]>(new Cell[n]);
+                        for(size_t i = 0; i < n; i++)
+                                m_cells[i].seq.store(i, memory_order_relaxed);
+                }
+                auto push(double value) -> bool {
+                        size_t pos = m_tail.load(memory_order_relaxed);
+                        for(;;){
+                                Cell& c = m_cells[pos & m_mask];
+                                size_t seq = c.seq.load(memory_order_acquire);
+                                intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+                                if(dif == 0){
+                                        if(m_tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                                                c.value = value;
+                                                c.seq.store(pos + 1, memory_order_release);
+                                                return true;
+                                        }
+                                } else if(dif < 0)
+                                        return false;
+                                else
+                                        pos = m_tail.load(memory_order_relaxed);
+                        }
+                }
+                // Single consumer
+                auto pop(double& value) -> bool {
+                        Cell& c = m_cells[m_head & m_mask];
+                        if(c.seq.load(memory_order_acquire) != m_head + 1)
+                                return false;
+                        value = c.value;
+                        c.seq.store(m_head + m_mask + 1, memory_order_release);
+                        m_head++;
+                        return true;
+                }
+        private:
+                struct Cell{ atomic<size_t> seq; double value; };
+                unique_ptr<Cell[]> m_cells;
+                size_t             m_mask;
+                alignas(64) atomic<size_t> m_tail{0};
+                alignas(64) size_t         m_head = 0;
+        };
+
+        struct Subscriber: enable_shared_from_this<Subscriber>{
+                const Token       token;
+                Observer          fn;
+                unique_ptr<Queue> queue;
+                thread            worker;
+                atomic<bool>      running{false};
+                atomic<uint64_t>  dropped{0};
+
+                Subscriber(Token token, Observer fn): token(token), fn(move(fn)) { }
+                ~Subscriber(){ this->stop(); }
+
+                void startAsync(size_t capacity){
+                        queue   = make_unique<Queue>(capacity);
+                        running = true;
+                        // The worker keeps the subscriber alive, so that it can
+                        // remove itself from its own callback.
+                        worker  = thread([this, self = shared_from_this()]{
+                                double value;
+                                for(;;){
+                                        if(queue->pop(value)){
+                                                fn(value);
+                                                continue;
+                                        }
+                                        if(!running.load(memory_order_acquire)){
+                                                // Drain values pushed before stop()
+                                                while(queue->pop(value)) fn(value);
+                                                return;
+                                        }
+                                        this_thread::sleep_for(chrono::microseconds(50));
+                                }
+                        });
+                }
+                void deliver(double value){
+                        if(!queue)
+                                fn(value);
+                        else if(!queue->push(value))
+                                dropped.fetch_add(1, memory_order_relaxed);
+                }
+                void stop(){
+                        running.store(false, memory_order_release);
+                        if(!worker.joinable())
+                                return;
+                        // Called from its own callback: joining would deadlock,
+                        // the worker exits after the callback returns.
+                        if(worker.get_id() == this_thread::get_id())
+                                worker.detach();
+                        else
+                                worker.join();
+                }
+        };
+
+        using List = vector<shared_ptr<Subscriber>>;
+
+        static constexpr size_t Shards = 16;
+        struct alignas(64) Counter{ atomic<int64_t> n{0}; };
+
+        // Readers register in a shard chosen per thread
+        struct ReadGuard{
+                const ConcurrentObservable& obs;
+                atomic<int64_t>*            counter;
+
+                ReadGuard(const ConcurrentObservable& o): obs(o) {
+                        static atomic<size_t> nextShard{0};
+                        thread_local size_t shard = nextShard++ % Shards;
+                        size_t parity = obs.m_epoch.load(memory_order_seq_cst) & 1;
+                        counter = &obs.m_readers[parity][shard].n;
+                        counter->fetch_add(1, memory_order_seq_cst);
+                        t_depth++;
+                }
+                ~ReadGuard(){
+                        counter->fetch_sub(1, memory_order_seq_cst);
+                        t_depth--;
+                }
+        };
+        static inline thread_local int t_depth = 0;
+
+        atomic<List*>    m_list;
+        mutable Counter  m_readers[2][Shards];
+        atomic<uint64_t> m_epoch{0};
+        mutex            m_writeMutex;
+        atomic<Token>    m_nextToken{1};
+
+        static void checkNotInCallback(){
+                if(t_depth > 0)
+                        throw logic_error("Observers cannot be changed from a notification");
+        }
+        // Copy-on-write update of the list of subscribers
+        template<typename Function>
+        void update(Function modify){
+                checkNotInCallback();
+                lock_guard<mutex> lock(m_writeMutex);
+                unique_ptr<List> copy(new List(*m_list.load()));
+                modify(*copy);
+                unique_ptr<List> old(m_list.exchange(copy.release(), memory_order_seq_cst));
+                this->synchronize();
+        }
+        // Grace period: wait until readers which could have seen the old
+        // list finish. Two flips are needed because a reader may have read
+        // the epoch before the first flip and registered after it.
+        void synchronize(){
+                for(int k = 0; k < 2; k++){
+                        uint64_t old = m_epoch.fetch_add(1, memory_order_seq_cst) & 1;
+                        for(auto& c: m_readers[old])
+                                while(c.n.load(memory_order_seq_cst) != 0)
+                                        this_thread::yield();
+                }
+        }
+};
+
 int main(){
 
   //-----------  Example(1) ----------------------------------------------------------------------------------------
@@ -259,5 +517,90 @@ int main(){
   tempSensor.notify(30.5);
   tempSensor.notify(20.5);  
 
+  //---------- Example (13)  ----------------------------------------------------------------------------------------
+  cout << endl;
+  cout <<"-----------------------------------------------------------------------------------------" << endl;
+  cout << ">> Example(13) - Concurrent observer pattern (event bus)" << endl;
+
+  ConcurrentObservable bus;
+  auto tok1 = bus.addObserver([](double temp){
+                  cout << "(sync observer) Temperature changed to " << temp <<  " C" << endl;
+          });
+  bus.addObserver([](double temp){
+                  cout << "(async observer) Temperature changed to " << temp <<  " C" << endl;
+          }, ConcurrentObservable::Delivery::Async);
+  // Asynchronous observer which removes itself on its first value
+  // (values already in its queue are still delivered)
+  atomic<ConcurrentObservable::Token> onceToken{0};
+  onceToken = bus.addObserver([&](double temp){
+                  cout << "(async once observer) Temperature changed to " << temp <<  " C" << endl;
+                  while(onceToken == 0) this_thread::yield();
+                  bus.removeObserver(onceToken);
+          }, ConcurrentObservable::Delivery::Async);
+  bus.notify(25.0);
+  bus.removeObserver(tok1);
+  bus.notify(26.0);
+  this_thread::sleep_for(chrono::milliseconds(10));
+  cout << "Observers left = " << bus.size() << endl;
+  auto badToken = bus.addObserver([&](double){
+          bus.addObserver([](double){ }, ConcurrentObservable::Delivery::Async);
+  });
+  try {
+          bus.notify(27.0);
+  } catch(const logic_error& ex) {
+          cout << "Expected error: " << ex.what() << endl;
+  }
+  bus.removeObserver(badToken);
+
+  //---------- Example (14)  ----------------------------------------------------------------------------------------
+  cout << endl;
+  cout <<"-----------------------------------------------------------------------------------------" << endl;
+  cout << ">> Example(14) - Benchmark: notifications from several producer threads" << endl;
+  {
+          ConcurrentObservable telemetry;
+          atomic<uint64_t> received{0};
+          vector<atomic<uint64_t>> counters(4);
+          for(auto& c: counters)
+                  telemetry.addObserver([&c](double){ c.fetch_add(1, memory_order_relaxed); });
+          auto asyncToken = telemetry.addObserver([&received](double){ received++; },
+                                                  ConcurrentObservable::Delivery::Async, 1 << 16);
+
+          const int producers = 4, perProducer = 1000000;
+          atomic<bool> done{false};
+          // Subscribers come and go while producers are running
+          auto churnLoop = [&]{
+                  while(!done){
+                          auto t = telemetry.addObserver([](double){ });
+                          telemetry.removeObserver(t);
+                  }
+          };
+          thread churn1(churnLoop), churn2(churnLoop);
+          auto t0 = chrono::steady_clock::now();
+          vector<thread> threads;
+          for(int p = 0; p < producers; p++)
+                  threads.emplace_back([&telemetry, p]{
+                          for(int i = 0; i < perProducer; i++)
+                                  telemetry.notify(p + i * 1e-6);
+                  });
+          for(auto& th: threads)
+                  th.join();
+          auto t1 = chrono::steady_clock::now();
+          done = true;
+          churn1.join();
+          churn2.join();
+          double secs = chrono::duration<double>(t1 - t0).count();
+          uint64_t sync = 0;
+          for(auto& c: counters) sync += c;
+          uint64_t dropped = telemetry.dropped();
+          // Removing the async observer drains its queue and joins its thread
+          telemetry.removeObserver(asyncToken);
+          cout << "  notifications = " << producers * perProducer
+               << " ; time = " << secs * 1000 << " ms"
+               << " ; rate = " << producers * perProducer / secs / 1e6 << " million/s" << endl;
+          cout << "  sync deliveries = " << sync
+               << " ; async deliveries = " << received
+               << " ; dropped (async queue full) = " << dropped << endl;
+  }
+
   return 0;
 }
@@ -1,6 +1,15 @@
 // File:   posix-daemon.cpp 
 // Brief:  Sample Posix Daemon encapsulated in a class with syslog. 
 // Author: Caio Rodrigues
+//
+// Compile with:
+// $ clang++ posix-daemon.cpp -o posix-daemon.bin -g -std=c++1z -Wall -Wextra -pthread
+//
+// Run single process daemon:           $ ./posix-daemon.bin
+// Run supervisor with 4 workers:       $ ./posix-daemon.bin --workers 4
+// Log to rotating file:                $ ./posix-daemon.bin --log-file /tmp/price.log
+// Run 1000 periodic jobs (timer wheel): $ ./posix-daemon.bin --timers 1000
+// Reload workers (graceful):           $ kill -HUP $(cat /tmp/price-server.pid)
 //-------------------------------------------------------------------
 
 #include <iostream>
@@ -12,21 +21,527 @@
 #include <fstream>
 #include <iomanip>
 #include <memory> // Smart pointer 
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring> // string.h
 #include <csignal>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <ctime>
 
 //------ U*nix only ----//
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h> // Linux only 
+#include <fcntl.h>
+#include <sched.h> // sched_setaffinity (Linux)
 // Syslog
 #include <syslog.h>
 
 
+/** Asynchronous logger: log() formats the message into a slot of a
+ *  bounded lock-free queue and returns immediately, a background thread
+ *  takes the records in batches and writes them to syslog or to a
+ *  rotating log file. Thus the daemon action never blocks on the
+ *  /dev/log socket or on disk IO. A batch of file records is written with
+ *  a single write(), syslog records are still sent one syslog() call each.
+ *
+ *  The queue is a bounded multi-producer queue (Dmitry Vyukov's algorithm),
+ *  every slot has a sequence number indicating whether it is free or filled.
+ *
+ *  Note: threads do not survive fork(), so start() must be called in the
+ *  process which logs. PosixDaemon does it after forking.
+ */
+class AsyncLogger{
+public:
+	/// What to do when the queue is full 
+	enum class Policy { Drop, Block };
+	enum class Sink   { Syslog, File };
+
+	/// Log to syslog 
+	AsyncLogger(size_t capacity = 8192, Policy policy = Policy::Drop)
+		: AsyncLogger(Sink::Syslog, "", capacity, policy) { }
+
+	/// Log to a file which is rotated to file.1, file.2 ... when it
+	/// exceeds maxBytes.
+	AsyncLogger(std::string file, size_t maxBytes, unsigned maxFiles
+				, size_t capacity = 8192, Policy policy = Policy::Drop)
+		: AsyncLogger(Sink::File, std::move(file), capacity, policy) {
+		m_maxBytes = maxBytes;
+		m_maxFiles = maxFiles;
+	}
+
+	~AsyncLogger(){ this->stop(); }
+
+	AsyncLogger(const AsyncLogger&) = delete;
+	AsyncLogger& operator= (const AsyncLogger&) = delete;
+
+	auto start() -> void {
+		if(m_running) return;
+		if(m_sink == Sink::File) this->openFile();
+		m_running = true;
+		m_thread  = std::thread([this]{ this->consume(); });
+	}
+
+	/// Stop the background thread after flushing all pending records 
+	auto stop() -> void {
+		if(!m_running) return;
+		m_running = false;
+		m_thread.join();
+		if(m_fd >= 0){
+			::close(m_fd);
+			m_fd = -1;
+		}
+	}
+
+	/// printf-like logging function. If the logger is not started, the
+	/// message is written synchronously to syslog. 
+	__attribute__((format(printf, 3, 4)))
+	auto log(int priority, const char* format, ...) -> void {
+		va_list args;
+		va_start(args, format);
+		if(!m_running){
+			vsyslog(priority, format, args);
+			va_end(args);
+			return;
+		}
+		Cell* cell = this->acquire();
+		if(cell == nullptr){
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			va_end(args);
+			return;
+		}
+		cell->priority = priority;
+		::clock_gettime(CLOCK_REALTIME, &cell->time);
+		std::vsnprintf(cell->text, sizeof(cell->text), format, args);
+		va_end(args);
+		// Publish the record to the consumer 
+		cell->sequence.store(cell->position + 1, std::memory_order_release);
+	}
+
+	/// Number of records dropped because the queue was full 
+	auto dropped() const -> uint64_t { return m_dropped.load(); }
+	/// Number of records written to the sink. Records lost by a failed
+	/// or short write() are not counted.
+	auto written() const -> uint64_t { return m_written.load(); }
+	/// Number of times a producer waited for free space (Policy::Block)
+	auto blocked() const -> uint64_t { return m_blocked.load(); }
+	
+private:
+	struct Cell{
+		std::atomic<size_t> sequence;
+		size_t              position;
+		int                 priority;
+		struct timespec     time;
+		char                text[256];
+	};
+
+	static constexpr size_t batchSize = 64;
+
+	Sink                    m_sink;
+	std::string             m_file;
+	Policy                  m_policy;
+	size_t                  m_mask;
+	std::unique_ptr<Cell[]> m_cells;
+	alignas(64) std::atomic<size_t> m_enqueue{0};
+	alignas(64) size_t              m_dequeue = 0;
+	alignas(64) std::atomic<bool>   m_running{false};
+	std::atomic<uint64_t>   m_dropped{0};
+	std::atomic<uint64_t>   m_written{0};
+	std::atomic<uint64_t>   m_blocked{0};
+	std::thread             m_thread;
+	int                     m_fd = -1;
+	size_t                  m_fileSize = 0;
+	size_t                  m_maxBytes = 0;
+	unsigned                m_maxFiles = 0;
+
+	AsyncLogger(Sink sink, std::string file, size_t capacity, Policy policy)
+		: m_sink(sink), m_file(std::move(file)), m_policy(policy){
+		// Round capacity up to a power of two 
+		size_t n = 2;
+		while(n < capacity) n <<= 1;
+		m_mask  = n - 1;
+		m_cells = std::unique_ptr<Cell[]>(new Cell[n]);
+		for(size_t i = 0; i < n; i++)
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	/// Reserve a free slot, returns nullptr if the queue is full and the
+	/// policy is Drop or the logger is stopping, as then no consumer will
+	/// free a slot.
+	auto acquire() -> Cell* {
+		size_t pos = m_enqueue.load(std::memory_order_relaxed);
+		unsigned spins = 0;
+		for(;;){
+			Cell& cell = m_cells[pos & m_mask];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if(diff == 0){
+				if(m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					cell.position = pos;
+					return &cell;
+				}
+			} else if(diff < 0){
+				// Queue full 
+				if(m_policy == Policy::Drop || !m_running.load(std::memory_order_acquire))
+					return nullptr;
+				if(spins++ == 0) m_blocked.fetch_add(1, std::memory_order_relaxed);
+				if(spins < 64) std::this_thread::yield();
+				else std::this_thread::sleep_for(std::chrono::microseconds(50));
+				pos = m_enqueue.load(std::memory_order_relaxed);
+			} else {
+				pos = m_enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	auto consume() -> void {
+		std::string batch;
+		batch.reserve(batchSize * 300);
+		// End offset of every record in the batch 
+		std::vector<size_t> ends;
+		ends.reserve(batchSize);
+		for(;;){
+			// Read the flag before draining, so that records published
+			// before stop() are not lost.
+			bool running = m_running.load(std::memory_order_acquire);
+			size_t count = 0;
+			batch.clear();
+			ends.clear();
+			while(count < batchSize){
+				Cell& cell = m_cells[m_dequeue & m_mask];
+				size_t seq = cell.sequence.load(std::memory_order_acquire);
+				if(seq != m_dequeue + 1) break;
+				this->format(cell, batch);
+				ends.push_back(batch.size());
+				// Release the slot for producers 
+				cell.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+				m_dequeue++;
+				count++;
+			}
+			if(count > 0){
+				size_t written = m_sink == Sink::Syslog ? count : this->flush(batch, ends);
+				m_written.fetch_add(written, std::memory_order_relaxed);
+				continue;
+			}
+			if(!running) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	auto format(const Cell& cell, std::string& batch) -> void {
+		if(m_sink == Sink::Syslog){
+			// syslog() has no batch API, records are sent one by one
+			// from this thread.
+			syslog(cell.priority, "%s", cell.text);
+			return;
+		}
+		char header[64];
+		struct tm tm;
+		::localtime_r(&cell.time.tv_sec, &tm);
+		size_t n = std::strftime(header, sizeof(header), "%Y-%m-%d %H:%M:%S", &tm);
+		std::snprintf(header + n, sizeof(header) - n, ".%03ld [%d] "
+					  , cell.time.tv_nsec / 1000000, cell.priority);
+		batch += header;
+		batch += cell.text;
+		batch += '\n';
+	}
+
+	/// Write the batch to the log file, returns the number of complete
+	/// records written. Normally a single write() system call per batch,
+	/// short writes are resumed until the batch is done or write() fails.
+	auto flush(const std::string& batch, const std::vector<size_t>& ends) -> size_t {
+		if(m_fd < 0) return 0;
+		size_t done = 0;
+		while(done < batch.size()){
+			ssize_t n = ::write(m_fd, batch.data() + done, batch.size() - done);
+			if(n < 0 && errno == EINTR) continue;
+			if(n <= 0) break;
+			done += n;
+		}
+		m_fileSize += done;
+		if(m_maxBytes > 0 && m_fileSize >= m_maxBytes)
+			this->rotate();
+		return std::upper_bound(ends.begin(), ends.end(), done) - ends.begin();
+	}
+
+	auto openFile() -> void {
+		m_fd = ::open(m_file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		struct stat st;
+		m_fileSize = (m_fd >= 0 && ::fstat(m_fd, &st) == 0) ? st.st_size : 0;
+	}
+
+	/// file.(n-1) -> file.n, ..., file -> file.1 
+	auto rotate() -> void {
+		::close(m_fd);
+		for(unsigned i = m_maxFiles; i > 1; i--){
+			std::string from = m_file + "." + std::to_string(i - 1);
+			std::string to   = m_file + "." + std::to_string(i);
+			::rename(from.c_str(), to.c_str());
+		}
+		if(m_maxFiles > 0)
+			::rename(m_file.c_str(), (m_file + ".1").c_str());
+		else
+			::unlink(m_file.c_str());
+		this->openFile();
+	}
+};
+
+/** Hierarchical timer wheel driven by a single Linux timerfd. 
+ * 
+ *  Jobs are stored in intrusive doubly linked lists, one list per slot,
+ *  so scheduling and cancelling a job are O(1) regardless of the number
+ *  of jobs. There are 4 wheels of 256 slots: the first one has a
+ *  resolution of one tick, the next one of 256 ticks and so on. When the
+ *  first wheel completes a turn, the jobs in the current slot of the next
+ *  wheel are cascaded down to the finer wheel.
+ *
+ *  Callbacks are executed on the thread which calls run() or
+ *  onTimerReadable(). The timerfd file descriptor can also be added
+ *  to an epoll() event loop.
+ */
+class TimerWheel{
+public:
+	using Callback = std::function<void ()>;
+	using Duration = std::chrono::milliseconds;
+
+	/// Handle used to cancel a job. The generation field detects handles of
+	/// jobs which have already finished and whose node was reused.
+	struct TimerId{
+		uint32_t index      = UINT32_MAX;
+		uint32_t generation = 0;
+	};
+
+	explicit TimerWheel(Duration tick = Duration(10)): m_tick(tick) {
+		for(auto& wheel: m_slots)
+			for(auto& head: wheel) head = npos;
+	}
+	~TimerWheel(){
+		if(m_fd >= 0) ::close(m_fd);
+	}
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel& operator= (const TimerWheel&) = delete;
+
+	/// Schedule a one-shot job executed after the delay 
+	auto after(Duration delay, Callback callback) -> TimerId {
+		return this->add(this->toTicks(delay), 0, std::move(callback));
+	}
+
+	/// Schedule a periodic job, the first execution happens after one period 
+	auto every(Duration period, Callback callback) -> TimerId {
+		uint64_t ticks = this->toTicks(period);
+		return this->add(ticks, ticks, std::move(callback));
+	}
+
+	/// Cancel a job, returns false if the job no longer exists. It is safe
+	/// to cancel a job from within its own callback. 
+	auto cancel(TimerId id) -> bool {
+		if(id.index >= m_nodes.size()) return false;
+		Node& node = m_nodes[id.index];
+		if(node.generation != id.generation || !node.active) return false;
+		if(id.index == m_running){
+			// The job is being executed, it is released after the callback 
+			node.period = 0;
+			return true;
+		}
+		this->unlink(id.index);
+		this->release(id.index);
+		return true;
+	}
+
+	/// Number of scheduled jobs 
+	auto size() const -> size_t { return m_count; }
+
+	/// Create the timerfd (if needed) which expires once per tick 
+	auto fd() -> int {
+		if(m_fd >= 0) return m_fd;
+		m_fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		if(m_fd < 0) return -1;
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(m_tick).count();
+		struct itimerspec spec;
+		spec.it_interval.tv_sec  = ns / 1000000000;
+		spec.it_interval.tv_nsec = ns % 1000000000;
+		spec.it_value = spec.it_interval;
+		::timerfd_settime(m_fd, 0, &spec, nullptr);
+		return m_fd;
+	}
+
+	/// Read the number of elapsed ticks from the timerfd and run expired
+	/// jobs. Call it when fd() is readable. Returns false on error.
+	auto onTimerReadable() -> bool {
+		uint64_t expirations = 0;
+		if(::read(this->fd(), &expirations, sizeof(expirations)) != sizeof(expirations))
+			return errno == EINTR || errno == EAGAIN;
+		this->advance(expirations);
+		return true;
+	}
+
+	/// Blocking loop, runs until the predicate returns false. A signal
+	/// handler installed without SA_RESTART interrupts the wait.
+	template<typename Predicate>
+	auto run(Predicate keepRunning) -> void {
+		if(this->fd() < 0) return;
+		while(keepRunning() && this->onTimerReadable())
+			;
+	}
+
+	/// Advance the wheel by the given number of ticks 
+	auto advance(uint64_t ticks) -> void {
+		while(ticks-- > 0){
+			m_now++;
+			// Cascade upper wheels when the lower wheel wraps around 
+			for(unsigned level = 1; level < levels; level++){
+				if(((m_now >> (bits * (level - 1))) & mask) != 0) break;
+				this->cascade(level, (m_now >> (bits * level)) & mask);
+			}
+			this->expire(m_now & mask);
+		}
+	}
+
+private:
+	static constexpr unsigned levels = 4;
+	static constexpr unsigned bits   = 8;
+	static constexpr uint64_t slots  = uint64_t(1) << bits;
+	static constexpr uint64_t mask   = slots - 1;
+	static constexpr uint32_t npos   = UINT32_MAX;
+
+	struct Node{
+		uint32_t prev       = npos;
+		uint32_t next       = npos;
+		uint32_t generation = 0;
+		bool     active     = false;
+		// Slot where the node is linked
+		uint8_t  level      = 0;
+		uint8_t  slot       = 0;
+		uint64_t expire     = 0;
+		uint64_t period     = 0;
+		Callback callback;
+	};
+
+	Duration              m_tick;
+	int                   m_fd      = -1;
+	uint64_t              m_now     = 0;
+	size_t                m_count   = 0;
+	uint32_t              m_free    = npos;
+	uint32_t              m_running = npos;
+	std::vector<Node>     m_nodes;
+	uint32_t              m_slots[levels][slots];
+
+	auto toTicks(Duration d) const -> uint64_t {
+		uint64_t t = (d.count() + m_tick.count() - 1) / m_tick.count();
+		return t > 0 ? t : 1;
+	}
+
+	auto add(uint64_t delay, uint64_t period, Callback callback) -> TimerId {
+		uint32_t index;
+		if(m_free != npos){
+			index  = m_free;
+			m_free = m_nodes[index].next;
+		} else {
+			index = static_cast<uint32_t>(m_nodes.size());
+			m_nodes.emplace_back();
+		}
+		Node& node    = m_nodes[index];
+		node.active   = true;
+		node.expire   = m_now + delay;
+		node.period   = period;
+		node.callback = std::move(callback);
+		m_count++;
+		this->link(index);
+		return TimerId{index, node.generation};
+	}
+
+	auto release(uint32_t index) -> void {
+		Node& node = m_nodes[index];
+		node.active   = false;
+		node.callback = nullptr;
+		node.generation++;
+		node.next = m_free;
+		m_free    = index;
+		m_count--;
+	}
+
+	/// Insert node into the slot of the wheel matching its expiration time 
+	auto link(uint32_t index) -> void {
+		Node& node = m_nodes[index];
+		uint64_t delta = node.expire > m_now ? node.expire - m_now : 0;
+		unsigned level = 0;
+		while(level + 1 < levels && delta >= (uint64_t(1) << (bits * (level + 1))))
+			level++;
+		uint64_t expire = node.expire;
+		// Jobs beyond the range of the wheel wait in the last wheel 
+		if(level == levels - 1 && delta >= (uint64_t(1) << (bits * levels)))
+			expire = m_now + (uint64_t(1) << (bits * levels)) - 1;
+		node.level = static_cast<uint8_t>(level);
+		node.slot  = static_cast<uint8_t>((expire >> (bits * level)) & mask);
+		uint32_t& head = m_slots[level][node.slot];
+		node.prev = npos;
+		node.next = head;
+		if(head != npos) m_nodes[head].prev = index;
+		head = index;
+	}
+
+	auto unlink(uint32_t index) -> void {
+		Node& node = m_nodes[index];
+		if(node.prev != npos) m_nodes[node.prev].next = node.next;
+		else m_slots[node.level][node.slot] = node.next;
+		if(node.next != npos) m_nodes[node.next].prev = node.prev;
+		node.prev = node.next = npos;
+	}
+
+	/// Move all jobs of a slot of an upper wheel to lower wheels 
+	auto cascade(unsigned level, uint64_t slot) -> void {
+		uint32_t index = m_slots[level][slot];
+		m_slots[level][slot] = npos;
+		while(index != npos){
+			uint32_t next = m_nodes[index].next;
+			this->link(index);
+			index = next;
+		}
+	}
+
+	auto expire(uint64_t slot) -> void {
+		// Jobs are removed one at a time from the head of the slot, so that
+		// callbacks can cancel other jobs of the same slot. Jobs scheduled
+		// by callbacks never land in the current slot.
+		while(m_slots[0][slot] != npos){
+			uint32_t index = m_slots[0][slot];
+			this->unlink(index);
+			Node& node = m_nodes[index];
+			if(node.expire > m_now){
+				// Not yet expired (delay beyond the wheel range)
+				this->link(index);
+				continue;
+			}
+			m_running = index;
+			// Note: the callback may add jobs and reallocate m_nodes 
+			Callback callback = std::move(node.callback);
+			callback();
+			m_running = npos;
+			Node& n = m_nodes[index];
+			if(n.active && n.period > 0){
+				n.callback = std::move(callback);
+				n.expire   = m_now + n.period;
+				this->link(index);
+			} else if(n.active) {
+				this->release(index);
+			}
+		}
+	}
+};
+
+constexpr uint32_t TimerWheel::npos;
+constexpr uint64_t TimerWheel::mask;
+
 class PosixDaemon{
 public:
 	using Action = std::function<bool ()>;
@@ -35,65 +550,369 @@ public:
 		: m_path(std::move(path)),
 		  m_pidfile(std::move(pidfile)),
 		  m_action(action) { }
-	~PosixDaemon(){}	
+	/// Daemon without action, which only runs the jobs of the timer wheel.
+	PosixDaemon(std::string path, std::string pidfile)
+		: m_path(std::move(path)),
+		  m_pidfile(std::move(pidfile)) { }
+	~PosixDaemon(){
+		if(m_pidfd >= 0) ::close(m_pidfd);
+	}	
+	
+	/// Timer wheel for periodic and one-shot jobs executed in the daemon
+	/// (or in every worker process in supervisor mode). Jobs should be
+	/// scheduled before calling run() or supervise(). 
+	auto timers() -> TimerWheel& {
+		return m_timers;
+	}
+	
+	/// Use an asynchronous logger in the daemon (or worker) processes.
+	/// The logger thread is started after fork(). 
+	auto setLogger(AsyncLogger& logger) -> void {
+		m_logger = &logger;
+	}
 	
 	// Disable copy constructor in order to forbid copy 
 	PosixDaemon(const PosixDaemon&) = delete;
 	// Disable copy-assignment operator to make the class non-copiable.
 	PosixDaemon& operator= (const PosixDaemon&) = delete;
-	
+
+	/// Run the action in a single daemon process. 
 	auto run() -> void {
+		if(!this->daemonize()) return;
+		// Close stdin, stdout and stderr file descriptors.
+		close(STDIN_FILENO);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+		this->installStopHandler();
+		this->loop();
+	}
+
+	/** Supervisor mode: the daemon process pre-forks N worker processes
+	 *  which run the action loop and are pinned to CPU (i mod number of CPUs).
+	 *   + Crashed workers are restarted after an exponential backoff delay.
+	 *   + SIGHUP performs a graceful reload: a new generation of workers is
+	 *     spawned before the old workers are asked to finish (SIGTERM). 
+	 *   + SIGTERM or SIGINT stops all workers and the supervisor.
+	 */
+	auto supervise(unsigned workers) -> void {
+		if(!this->daemonize()) return;
+		close(STDIN_FILENO);
+		close(STDOUT_FILENO);
+		close(STDERR_FILENO);
+
+		// Signals are handled synchronously with sigtimedwait() 
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigaddset(&mask, SIGCHLD);
+		sigaddset(&mask, SIGHUP);
+		sigaddset(&mask, SIGTERM);
+		sigaddset(&mask, SIGINT);
+		::sigprocmask(SIG_BLOCK, &mask, &m_oldmask);
+
+		m_workers.assign(workers, Worker{});
+		for(unsigned i = 0; i < workers; i++)
+			this->spawn(i);
+		syslog(LOG_INFO, "Supervisor started %u workers", workers);
+
+		bool running = true;
+		while(running){
+			struct timespec timeout = { 0, 100 * 1000 * 1000 }; // 100 ms 
+			int sig = ::sigtimedwait(&mask, nullptr, &timeout);
+			if(sig == SIGTERM || sig == SIGINT)
+				running = false;
+			else if(sig == SIGHUP)
+				this->reload();
+			this->reap();
+			this->restartPending();
+		}
+		syslog(LOG_INFO, "Supervisor shutting down");
+		this->stopWorkers();
+		// The file is truncated rather than removed, since a new instance
+		// waiting for the lock already holds it open.
+		::ftruncate(m_pidfd, 0);
+	}
+	
+private:
+	using Clock = std::chrono::steady_clock;
+
+	/// State of a worker slot 
+	struct Worker{
+		pid_t             pid       = -1;
+		unsigned          crashes   = 0;
+		Clock::time_point started   = {};
+		Clock::time_point restartAt = {};
+		bool              pending   = false;
+	};
+
+	std::string m_path;
+	std::string m_pidfile;
+	Action m_action;
+	// Action m_onExit;
+	// File descriptor of PID file, locked with flock() during daemon lifetime
+	int m_pidfd = -1;
+	AsyncLogger* m_logger = nullptr;
+	TimerWheel   m_timers;
+	std::vector<Worker> m_workers;
+	// Workers of previous generations, finishing after a reload 
+	std::vector<pid_t>  m_draining;
+	sigset_t            m_oldmask;
+
+	static constexpr std::chrono::milliseconds backoffMin{100};
+	static constexpr std::chrono::milliseconds backoffMax{30000};
+	// A worker which ran longer than this is considered healthy.
+	static constexpr std::chrono::seconds      stableTime{10};
+	// Maximum wait for a running instance to publish its PID 
+	static constexpr std::chrono::seconds      pidWaitTime{2};
+
+	// Set by SIGTERM in worker processes 
+	static volatile sig_atomic_t& stopFlag(){
+		static volatile sig_atomic_t flag = 0;
+		return flag;
+	}
+
+	auto daemonize() -> bool {
 		// Make child process
 		pid_t child_pid = fork();
 		if(child_pid < 0){
 			std::cerr << "Error: failed to fork this process." << "\n";
-			return;
+			return false;
 		}
 		if(child_pid > 0){
 			std::cout << "Process ID of child process = " << child_pid << "\n";
-			return;
+			return false;
 		}
 		// Umask file mode
 		::umask(0);
 		// Set new session
 		pid_t sid = ::setsid();
 		if(sid < 0)
-			return;
+			return false;
 		//------ Code of Forked Process ---------//
 		// Set path of forked process (daemon)
 		::chdir(m_path.c_str());
+		return this->lockPidFile();
+	}
 
-		// Check whether there is a running process of this program 
-		auto fs = std::ifstream(m_pidfile);
-		if(fs.good()){
-			int pid;
-			fs >> pid;
-			std::cerr << " [LOG] Kill process of PID = " << pid << "\n";
-			::kill(-pid, SIGTERM);
-			fs.close();							
-		}
-		auto fo = std::ofstream(m_pidfile);
-		if(fo.good()){
-			int pid = ::getpid();
-			std::cerr << "Child PID = " << pid << "\n";
-			fo << pid  << std::flush;
-		} else {
+	/** Take ownership of the PID file with an exclusive flock(). If another
+	 *  instance holds the lock, it is asked to terminate and this process
+	 *  waits until the lock is released. The lock is released by the kernel
+	 *  when the process exits, so stale PID files from crashed daemons do
+	 *  not matter.
+	 */
+	auto lockPidFile() -> bool {
+		m_pidfd = ::open(m_pidfile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if(m_pidfd < 0){
 			std::cerr << " [LOG] Error: could not open PID file " << m_pidfile << "\n";
+			return false;
+		}
+		if(::flock(m_pidfd, LOCK_EX | LOCK_NB) < 0 && !this->stopRunningInstance())
+			return false;
+		std::string pid = std::to_string(::getpid());
+		std::cerr << "Child PID = " << pid << "\n";
+		if(::ftruncate(m_pidfd, 0) < 0
+		   || ::pwrite(m_pidfd, pid.data(), pid.size(), 0) != static_cast<ssize_t>(pid.size()))
+		{
+			std::cerr << " [LOG] Error: could not write PID file " << m_pidfile << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	/** Send SIGTERM to the instance holding the PID file lock and wait
+	 *  until it exits. The running instance writes its PID just after
+	 *  taking the lock, so the file may still be empty: it is polled for
+	 *  at most pidWaitTime. Returns false without blocking if no PID shows
+	 *  up or the process cannot be signaled.
+	 */
+	auto stopRunningInstance() -> bool {
+		int  pid      = 0;
+		auto deadline = Clock::now() + pidWaitTime;
+		for(;;){
+			char buffer[32] = {0};
+			ssize_t n = ::pread(m_pidfd, buffer, sizeof(buffer) - 1, 0);
+			pid = n > 0 ? std::atoi(buffer) : 0;
+			if(pid > 0) break;
+			// The running instance may have exited meanwhile 
+			if(::flock(m_pidfd, LOCK_EX | LOCK_NB) == 0) return true;
+			if(Clock::now() >= deadline){
+				std::cerr << " [LOG] Error: PID file " << m_pidfile
+						  << " is locked, but holds no PID" << "\n";
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		std::cerr << " [LOG] Kill process of PID = " << pid << "\n";
+		if(::kill(pid, SIGTERM) < 0){
+			std::cerr << " [LOG] Error: could not send SIGTERM to PID = " << pid
+					  << ": " << strerror(errno) << "\n";
+			return false;
+		}
+		// Blocks until the running instance exits
+		if(::flock(m_pidfd, LOCK_EX) < 0){
+			std::cerr << " [LOG] Error: could not lock PID file " << m_pidfile << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	/// Fork the worker of slot index 
+	auto spawn(unsigned index) -> void {
+		Worker& w = m_workers[index];
+		pid_t pid = ::fork();
+		if(pid < 0){
+			syslog(LOG_ERR, "Failed to fork worker %u: %s", index, strerror(errno));
+			this->schedule(w);
 			return;
-		}	
-		// Close stdin, stdout and stderr file descriptors.
-		close(STDIN_FILENO);
-		close(STDOUT_FILENO);
-		close(STDERR_FILENO);
-		while(m_action());
-	}	
-private:
-	std::string m_path;
-	std::string m_pidfile;
-	Action m_action;
-	// Action m_onExit;
+		}
+		if(pid == 0){
+			this->runWorker(index);
+			// Never returns to the supervisor loop 
+			::_exit(EXIT_SUCCESS);
+		}
+		w.pid     = pid;
+		w.started = Clock::now();
+		w.pending = false;
+		syslog(LOG_INFO, "Worker %u started, PID = %d", index, pid);
+	}
+
+	auto runWorker(unsigned index) -> void {
+		::close(m_pidfd);
+		#ifdef __linux__
+		long ncpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+		if(ncpus > 0){
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(index % ncpus, &cpus);
+			::sched_setaffinity(0, sizeof(cpus), &cpus);
+		}
+		#endif
+		this->installStopHandler();
+		struct sigaction sa;
+		std::memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_DFL;
+		::sigaction(SIGHUP, &sa, nullptr);
+		::sigaction(SIGINT, &sa, nullptr);
+		::sigprocmask(SIG_SETMASK, &m_oldmask, nullptr);
+		this->loop();
+	}
+
+	/// SIGTERM sets the stop flag. SA_RESTART is not used so that it
+	/// interrupts the blocking read() of the timer wheel. 
+	auto installStopHandler() -> void {
+		struct sigaction sa;
+		std::memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = [](int){ stopFlag() = 1; };
+		::sigaction(SIGTERM, &sa, nullptr);
+	}
+
+	/// Loop of daemon process (or worker process)
+	auto loop() -> void {
+		if(m_logger) m_logger->start();
+		// The current action is completed before the process exits 
+		if(m_action)
+			while(!stopFlag() && m_action());
+		else 
+			m_timers.run([]{ return !stopFlag(); });
+		if(m_logger) m_logger->stop();
+	}
+
+	/// Schedule restart of a worker slot with exponential backoff 
+	auto schedule(Worker& w) -> void {
+		if(Clock::now() - w.started > stableTime)
+			w.crashes = 0;
+		auto delay = backoffMin * (1 << std::min(w.crashes, 16u));
+		if(delay > backoffMax) delay = backoffMax;
+		w.crashes++;
+		w.pid       = -1;
+		w.pending   = true;
+		w.restartAt = Clock::now() + delay;
+	}
+
+	/// Collect terminated workers 
+	auto reap() -> void {
+		int status;
+		pid_t pid;
+		while((pid = ::waitpid(-1, &status, WNOHANG)) > 0){
+			auto it = std::find(m_draining.begin(), m_draining.end(), pid);
+			if(it != m_draining.end()){
+				m_draining.erase(it);
+				continue;
+			}
+			for(size_t i = 0; i < m_workers.size(); i++){
+				if(m_workers[i].pid != pid) continue;
+				if(WIFSIGNALED(status))
+					syslog(LOG_WARNING, "Worker %zu (PID %d) killed by signal %d"
+						   , i, pid, WTERMSIG(status));
+				else
+					syslog(LOG_WARNING, "Worker %zu (PID %d) exited with status %d"
+						   , i, pid, WEXITSTATUS(status));
+				this->schedule(m_workers[i]);
+			}
+		}
+	}
+
+	auto restartPending() -> void {
+		auto now = Clock::now();
+		for(size_t i = 0; i < m_workers.size(); i++)
+			if(m_workers[i].pending && now >= m_workers[i].restartAt)
+				this->spawn(i);
+	}
+
+	/// Graceful reload: spawn new workers, then drain the old ones 
+	auto reload() -> void {
+		syslog(LOG_INFO, "Reloading workers");
+		std::vector<Worker> old;
+		old.swap(m_workers);
+		m_workers.assign(old.size(), Worker{});
+		for(unsigned i = 0; i < m_workers.size(); i++)
+			this->spawn(i);
+		for(auto& w: old)
+			if(w.pid > 0){
+				m_draining.push_back(w.pid);
+				::kill(w.pid, SIGTERM);
+			}
+	}
+
+	auto stopWorkers() -> void {
+		for(auto& w: m_workers)
+			if(w.pid > 0){
+				m_draining.push_back(w.pid);
+				::kill(w.pid, SIGTERM);
+			}
+		m_workers.clear();
+		while(!m_draining.empty()){
+			pid_t pid = ::waitpid(-1, nullptr, 0);
+			if(pid < 0) break;
+			auto it = std::find(m_draining.begin(), m_draining.end(), pid);
+			if(it != m_draining.end()) m_draining.erase(it);
+		}
+	}
 };
 
+constexpr std::chrono::milliseconds PosixDaemon::backoffMin;
+constexpr std::chrono::milliseconds PosixDaemon::backoffMax;
+constexpr std::chrono::seconds      PosixDaemon::stableTime;
+constexpr std::chrono::seconds      PosixDaemon::pidWaitTime;
+
+static auto usage(const char* program) -> void {
+	std::cerr << "Usage: " << program << " [--workers N] [--log-file FILE] [--timers N]" << "\n"
+			  << "  --workers N     run a supervisor with N > 0 worker processes" << "\n"
+			  << "  --log-file FILE log to FILE instead of syslog" << "\n"
+			  << "  --timers N      run N > 0 periodic jobs on a timer wheel" << "\n";
+}
+
+/// Parse a positive decimal count, returns false on invalid input 
+static auto parseCount(const char* text, unsigned& value) -> bool {
+	char* end = nullptr;
+	errno = 0;
+	unsigned long n = std::strtoul(text, &end, 10);
+	if(end == text || *end != '\0' || errno == ERANGE
+	   || text[0] == '-' || n == 0 || n > 1000000)
+		return false;
+	value = static_cast<unsigned>(n);
+	return true;
+}
+
 int main(int argc, char** argv){
 
 	std::random_device rdng;	
@@ -104,22 +923,70 @@ int main(int argc, char** argv){
 
 	setlogmask (LOG_UPTO (LOG_INFO));
 	openlog ("price-service", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_LOCAL1);	
+
+	unsigned    workers = 0;
+	std::string logfile;
+	unsigned    njobs   = 0;
+	for(int i = 1; i < argc; i += 2){
+		std::string opt = argv[i];
+		bool ok = i + 1 < argc;
+		if(ok && opt == "--workers")
+			ok = parseCount(argv[i + 1], workers);
+		else if(ok && opt == "--log-file")
+			logfile = argv[i + 1];
+		else if(ok && opt == "--timers")
+			ok = parseCount(argv[i + 1], njobs);
+		else
+			ok = false;
+		if(!ok){
+			std::cerr << "Error: invalid option or value: " << opt << "\n";
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	// Records are logged to syslog or to a file rotated every 1 MB  
+	std::unique_ptr<AsyncLogger> logger = logfile.empty()
+		? std::unique_ptr<AsyncLogger>(new AsyncLogger())
+		: std::unique_ptr<AsyncLogger>(new AsyncLogger(logfile, 1024 * 1024, 5));
 	
-	PosixDaemon daemon{		
+	// Action based daemon: the action is called in a loop. 
+	PosixDaemon actionDaemon{		
 		"/",
 		"/tmp/price-server.pid",
-		[&randomGen](){
+		[&randomGen, &logger](){
 			// Action executed in the child process (daemon)
-			std::stringstream ss;
-			ss << std::setprecision(3) << std::fixed;
-			ss << "Price = " << randomGen() << " path = " << getcwd(nullptr, 0) ;
-			syslog (LOG_INFO, "%s", ss.str().c_str());
+			logger->log(LOG_INFO, "Price = %.3f PID = %d dropped = %lu"
+						, randomGen(), ::getpid()
+						, static_cast<unsigned long>(logger->dropped()));
 			// 1 seconds delay
 			std::this_thread::sleep_for(std::chrono::seconds(1));
 			return true;
 		}					  
 	};
 
-	daemon.run();
+	// Timer based daemon: many periodic jobs on a single timerfd. 
+	PosixDaemon timerDaemon{ "/", "/tmp/price-server.pid" };
+	TimerWheel& timers = timerDaemon.timers();
+	for(unsigned i = 0; i < njobs; i++){
+		auto period = std::chrono::milliseconds(1000 + 10 * (i % 500));
+		timers.every(period, [i, &logger, &randomGen]{
+			logger->log(LOG_INFO, "Health check %u - price = %.3f", i, randomGen());
+		});
+	}
+	timers.every(std::chrono::seconds(10), [&logger, &timers]{
+		logger->log(LOG_INFO, "Flush - %zu jobs scheduled, %lu records dropped"
+					, timers.size(), static_cast<unsigned long>(logger->dropped()));
+	});
+	timers.after(std::chrono::seconds(5), [&logger]{
+		logger->log(LOG_INFO, "One-shot job executed after 5 seconds");
+	});
+
+	PosixDaemon& daemon = njobs > 0 ? timerDaemon : actionDaemon;
+	daemon.setLogger(*logger);
+
+	if(workers > 0)
+		daemon.supervise(workers);
+	else
+		daemon.run();
 	return 0;
 }
@@ -3,6 +3,11 @@
  * Brief:   Reverse Polish Notation Calculator
  * Description: A simple reverse polish notation command line calculator
  *              implemented in modern C++.
+ *
+ * Note: the commands are stored in inplace_function instead of std::function.
+ *       This change was not benchmarked for the calculator, it is dominated
+ *       by parsing and console IO. See Test 7 of lambda-bind.cpp for the
+ *       call and construction costs of both wrappers.
  ***************************************************************************/
 #include <iostream>
 #include <cmath>
@@ -16,6 +21,8 @@
 #include <functional>
 #include<limits>
 
+#include "../inplace-function.hpp"
+
 enum class ASTtype{
 	number,
 	function
@@ -125,12 +132,13 @@ public:
 class RPNEvaluator
 {
 private:
+  // Commands are stored without heap allocation (see inplace-function.hpp)
+  using CmdFun    = inplace_function<void (), 64>;
   Stack<double> _stack;
-  std::map<std::string, std::function<void ()>> _functions;
+  std::map<std::string, CmdFun> _functions;
 public:
-  using UnaryFun  = std::function<double (double)>;
-  using BinaryFun = std::function<double (double, double)>;
-  using CmdFun    = std::function<void ()>;
+  using UnaryFun  = inplace_function<double (double), 16>;
+  using BinaryFun = inplace_function<double (double, double), 16>;
 
   struct evalutor_error: public std::exception{
     const std::string text;
@@ -230,8 +238,7 @@ public:
   auto addBinaryFunction(const std::string& name, BinaryFun fun) -> void
   {
     _functions[name] =
-      [this, name, fun](){
-	//std::cerr << " Running function = " << name << std::endl;
+      [this, fun](){
 	this->push(fun(this->pop(), this->pop())) ;
       };
   }
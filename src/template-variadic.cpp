@@ -1,6 +1,9 @@
 // File:   template-variadic.cpp
 // Brief:  Examples about variadic templates.
 // Author: Caio Rodrigues
+//
+// Compile with:
+//  $ g++ template-variadic.cpp -o template-variadic.bin -std=c++1z -O2 -Wall -pthread -ldl
 //====================================================================================
 #include <iostream>
 #include <iomanip>
@@ -11,6 +14,18 @@
 #include <cmath>
 #include <functional>
 #include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <tuple>
+
+#include "inplace-function.hpp"
 
 // Unix (Linux, BSD, MacOSX)
 #ifndef _WIN32
@@ -38,32 +53,291 @@ void printTypes(const T& x, const Types ... args){
 
 /** ======= Invoke methods indirectly through member function pointers =================*/
 
+/** Command stored without heap allocation: the member function pointer
+ *  and the arguments must fit in 48 bytes (checked at compile time). */
+template<class T, class R = void>
+using Command = inplace_function<R (T& obj), 48>;
+
 template<class T, class R, class ... Args>
 auto makeCommand(
 	// Pointer to member function 
 	R (T::* pMemfn) (Args ... args),
 	// Member function arguments 
-	Args ... arglist) -> std::function<R (T& obj)> {
+	Args ... arglist) -> Command<T, R> {
 	return [=](T& obj){ return (obj.*pMemfn)(arglist ...); };
 }
 
 class CNCMachine{
 private:
 	std::string _machineid;
+	int    _speed = 0;
+	double _x = 0.0, _y = 0.0;
+	bool   _on = true;
 public:
+	/// Keys for CommandExecutor: consecutive commands with the same key
+	/// overwrite the same state, so only the last one needs to run.
+	enum CommandKey: int { Other = 0, Speed, Position };
+
+	// Disable messages (used by benchmarks)
+	static inline bool verbose = true;
+	// Simulated time taken by the equipment to acknowledge a command
+	static inline std::chrono::microseconds ioDelay{0};
+
 	CNCMachine(const std::string machineid):
 		_machineid(machineid){}
 	void setSpeed(int n){
+		this->wait();
+		_speed = n;
+		if(verbose)
 		std::cout << "[MACHINE] id = " <<  _machineid
 				  << " Set machine speed to level " << n << "\n";
 	}
 	void setPosition(double x, double y){
+		this->wait();
+		_x = x;
+		_y = y;
+		if(verbose)
 		std::cout << "[MACHINE] id = " <<  _machineid << "  Equipment to position set to "
 				  << " x = " << x << " ; y = " << y << "\n";
 	}
 	void shutdown(){
+		this->wait();
+		_on = false;
+		if(verbose)
 		std::cout << "[MACHINE] id = " <<  _machineid << " Shutdown equipment" << "\n";
 	}
+	auto speed() const -> int    { return _speed; }
+	auto x()     const -> double { return _x; }
+	auto y()     const -> double { return _y; }
+	auto isOn()  const -> bool   { return _on; }
+private:
+	void wait() const {
+		if(ioDelay.count() > 0)
+			std::this_thread::sleep_for(ioDelay);
+	}
+};
+
+/** Runs command streams for many objects (machines) concurrently.
+ *
+ *  + Each object has its own multiple-producer single-consumer queue:
+ *    producers append under a per-object lock, and a worker takes the
+ *    whole queue at once (swapping vectors), so commands are executed in
+ *    batches without holding the lock.
+ *  + An object is in the ready list at most once, so its commands are
+ *    always executed in submission order by one worker at a time, while
+ *    different objects run in parallel on the worker pool.
+ *  + Consecutive commands of a batch with the same non-zero coalescing
+ *    key are collapsed: only the last one is executed.
+ *  + Latency from submission to completion of each command is recorded
+ *    in per-worker log2 histograms.
+ *
+ *  The objects must outlive the executor. Exceptions thrown by commands
+ *  are counted and the first one is rethrown by waitIdle().
+ */
+template<class T>
+class CommandExecutor{
+public:
+	using clock = std::chrono::steady_clock;
+
+	struct Stats{
+		uint64_t executed  = 0;
+		uint64_t coalesced = 0;
+		uint64_t failed    = 0;
+		double   meanUs    = 0.0;
+		// Percentiles are upper bounds of the histogram buckets
+		double   p50Us     = 0.0;
+		double   p99Us     = 0.0;
+		double   maxUs     = 0.0;
+	};
+
+	CommandExecutor(std::vector<T>& objects, unsigned nthreads = 0)
+		: m_objects(objects)
+		, m_slots(new Slot[objects.size()])
+	{
+		if(nthreads == 0)
+			nthreads = std::max(1u, std::thread::hardware_concurrency());
+		m_stats = std::unique_ptr<WorkerStats[]>(new WorkerStats[nthreads]);
+		for(unsigned i = 0; i < nthreads; i++)
+			m_threads.emplace_back([this, i]{ this->workerLoop(m_stats[i]); });
+	}
+	CommandExecutor(const CommandExecutor&) = delete;
+	auto operator=(const CommandExecutor&) -> CommandExecutor& = delete;
+
+	/// Executes all pending commands before returning.
+	~CommandExecutor(){
+		{
+			std::lock_guard<std::mutex> lock(m_readyMutex);
+			m_stop = true;
+		}
+		m_readyCv.notify_all();
+		for(auto& th: m_threads)
+			th.join();
+	}
+
+	/// Thread-safe. Enqueue command for object at index.
+	auto submit(size_t index, Command<T> cmd, int coalesceKey = 0) -> void {
+		Slot& slot = m_slots[index];
+		m_pending.fetch_add(1);
+		{
+			std::lock_guard<std::mutex> lock(slot.mutex);
+			slot.queue.push_back(Entry{coalesceKey, std::move(cmd), clock::now()});
+		}
+		if(!slot.scheduled.exchange(true))
+			this->schedule(index);
+	}
+
+	/// Block until all submitted commands were executed.
+	auto waitIdle() -> void {
+		std::unique_lock<std::mutex> lock(m_idleMutex);
+		m_idleCv.wait(lock, [this]{ return m_pending.load() == 0; });
+		if(m_error){
+			auto e = std::exchange(m_error, nullptr);
+			std::rethrow_exception(e);
+		}
+	}
+
+	auto stats() const -> Stats {
+		Stats st;
+		uint64_t hist[64] = {};
+		uint64_t total = 0, maxNs = 0;
+		for(size_t w = 0; w < m_threads.size(); w++){
+			const WorkerStats& ws = m_stats[w];
+			st.executed  += ws.executed.load(std::memory_order_relaxed);
+			st.coalesced += ws.coalesced.load(std::memory_order_relaxed);
+			st.failed    += ws.failed.load(std::memory_order_relaxed);
+			total        += ws.totalNs.load(std::memory_order_relaxed);
+			maxNs         = std::max(maxNs, ws.maxNs.load(std::memory_order_relaxed));
+			for(int b = 0; b < 64; b++)
+				hist[b] += ws.histogram[b].load(std::memory_order_relaxed);
+		}
+		if(st.executed == 0)
+			return st;
+		// Upper bound of the bucket, which cannot exceed the maximum sample
+		auto percentile = [&](double q){
+			uint64_t rank = static_cast<uint64_t>(q * (st.executed - 1)) + 1, seen = 0;
+			for(int b = 0; b < 64; b++)
+				if((seen += hist[b]) >= rank)
+					return std::min(std::ldexp(1.0, b), static_cast<double>(maxNs)) / 1000.0;
+			return maxNs / 1000.0;
+		};
+		st.meanUs = total / 1000.0 / st.executed;
+		st.p50Us  = percentile(0.50);
+		st.p99Us  = percentile(0.99);
+		st.maxUs  = maxNs / 1000.0;
+		return st;
+	}
+
+private:
+	struct Entry{
+		int               key;
+		Command<T>        cmd;
+		clock::time_point enqueued;
+	};
+	struct Slot{
+		std::mutex         mutex;
+		std::vector<Entry> queue;
+		// True while the object is in the ready list or being executed
+		std::atomic<bool>  scheduled{false};
+	};
+	struct alignas(64) WorkerStats{
+		std::atomic<uint64_t> executed{0}, coalesced{0}, failed{0}, totalNs{0}, maxNs{0};
+		// Bucket b counts latencies in [2^(b-1), 2^b) nanoseconds
+		std::atomic<uint64_t> histogram[64] = {};
+	};
+
+	std::vector<T>&                m_objects;
+	std::unique_ptr<Slot[]>        m_slots;
+	std::unique_ptr<WorkerStats[]> m_stats;
+	std::vector<std::thread>       m_threads;
+
+	std::mutex              m_readyMutex;
+	std::condition_variable m_readyCv;
+	std::deque<size_t>      m_ready;
+	bool                    m_stop = false;
+
+	std::atomic<size_t>     m_pending{0};
+	std::mutex              m_idleMutex;
+	std::condition_variable m_idleCv;
+	std::exception_ptr      m_error;
+
+	auto schedule(size_t index) -> void {
+		{
+			std::lock_guard<std::mutex> lock(m_readyMutex);
+			m_ready.push_back(index);
+		}
+		m_readyCv.notify_one();
+	}
+
+	auto workerLoop(WorkerStats& stats) -> void {
+		std::vector<Entry> batch;
+		for(;;){
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(m_readyMutex);
+				m_readyCv.wait(lock, [this]{ return m_stop || !m_ready.empty(); });
+				// Pending work is finished before stopping
+				if(m_ready.empty())
+					return;
+				index = m_ready.front();
+				m_ready.pop_front();
+			}
+			this->runBatch(index, batch, stats);
+		}
+	}
+
+	auto runBatch(size_t index, std::vector<Entry>& batch, WorkerStats& stats) -> void {
+		Slot& slot = m_slots[index];
+		T&    obj  = m_objects[index];
+		{
+			std::lock_guard<std::mutex> lock(slot.mutex);
+			batch.swap(slot.queue);
+		}
+		const size_t n = batch.size();
+		for(size_t i = 0; i < n; i++){
+			Entry& e = batch[i];
+			if(e.key != 0 && i + 1 < n && batch[i + 1].key == e.key){
+				stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			try {
+				e.cmd(obj);
+			} catch(...) {
+				stats.failed.fetch_add(1, std::memory_order_relaxed);
+				std::lock_guard<std::mutex> lock(m_idleMutex);
+				if(!m_error) m_error = std::current_exception();
+			}
+			this->record(stats, clock::now() - e.enqueued);
+		}
+		batch.clear();
+
+		// Commands submitted while running have not scheduled the object,
+		// so it must be scheduled again here.
+		slot.scheduled.store(false);
+		bool hasMore;
+		{
+			std::lock_guard<std::mutex> lock(slot.mutex);
+			hasMore = !slot.queue.empty();
+		}
+		if(hasMore && !slot.scheduled.exchange(true))
+			this->schedule(index);
+
+		if(m_pending.fetch_sub(n) == n){
+			std::lock_guard<std::mutex> lock(m_idleMutex);
+			m_idleCv.notify_all();
+		}
+	}
+
+	auto record(WorkerStats& stats, clock::duration latency) -> void {
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+		int b = 0;
+		for(uint64_t v = ns; v != 0; v >>= 1)
+			b++;
+		stats.executed.fetch_add(1, std::memory_order_relaxed);
+		stats.totalNs.fetch_add(ns, std::memory_order_relaxed);
+		stats.histogram[std::min(b, 63)].fetch_add(1, std::memory_order_relaxed);
+		if(ns > stats.maxNs.load(std::memory_order_relaxed))
+			stats.maxNs.store(ns, std::memory_order_relaxed);
+	}
 };
 
 
@@ -73,11 +347,11 @@ public:
  *  Requires: #include <dlfcn.h> and -ldl linker flag */
 using LibHandle = std::unique_ptr<void, std::function<void (void*)>>;
 
-auto loadDLL(const std::string& libPath) -> LibHandle {
+auto loadDLL(const std::string& libPath, int flags = RTLD_LAZY) -> LibHandle {
 	// Return unique_ptr for RAAI -> Resource Acquisition is Initialization
 	// releasing closing handle when the unique_ptr goes out of scope. 
 	return LibHandle(
-		dlopen(libPath.c_str(), RTLD_LAZY),
+		dlopen(libPath.c_str(), flags),
 		[](void* h){
 			std::cout << " [INFO] Shared library handle released OK." << "\n";
 			dlclose(h);
@@ -94,6 +368,144 @@ auto loadSymbol(const LibHandle& handle, const std::string& symbol) -> Function*
 	return reinterpret_cast<Function*>(voidptr);
 }
 
+/** Function pointer from a shared library, bound by PluginRegistry.
+ *  After binding, a call is a plain indirect call with no dlsym() and no
+ *  string lookup. With lazy binding the symbol is resolved by dlsym()
+ *  on the first call; a missing symbol throws std::runtime_error then.
+ *  Call get() outside hot loops to resolve it up front. Rebinding a symbol
+ *  while other threads call it is safe, the calls use either binding. */
+template<typename Function>
+class Symbol;
+
+template<typename R, typename... Args>
+class Symbol<R (Args...)>{
+public:
+	using FunctionPtr = R (*)(Args...);
+
+	explicit Symbol(const char* name): m_name(name) { }
+	Symbol(const Symbol&) = delete;
+	auto operator=(const Symbol&) -> Symbol& = delete;
+
+	auto operator()(Args... args) const -> R {
+		FunctionPtr fn = m_fn.load(std::memory_order_acquire);
+		if(fn == nullptr)
+			fn = this->resolve();
+		return fn(std::forward<Args>(args)...);
+	}
+	auto get() const -> FunctionPtr {
+		FunctionPtr fn = m_fn.load(std::memory_order_acquire);
+		return fn != nullptr ? fn : this->resolve();
+	}
+	auto name() const -> const char* { return m_name; }
+	auto isResolved() const -> bool { return m_fn.load() != nullptr; }
+
+private:
+	friend class PluginRegistry;
+	const char*                      m_name;
+	// Guards m_handle, only taken by binding and by lazy resolution
+	mutable std::mutex               m_mutex;
+	void*                            m_handle = nullptr;
+	mutable std::atomic<FunctionPtr> m_fn{nullptr};
+
+	// Function pointer in the library or nullptr, does not change the symbol
+	auto lookup(void* handle) const -> FunctionPtr {
+		return reinterpret_cast<FunctionPtr>(dlsym(handle, m_name));
+	}
+	// Set handle and function pointer, which is nullptr for lazy binding
+	auto commit(void* handle, FunctionPtr fn) -> void {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_handle = handle;
+		m_fn.store(fn, std::memory_order_release);
+	}
+	auto resolve() const -> FunctionPtr {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Resolved by another thread meanwhile 
+		if(FunctionPtr fn = m_fn.load(std::memory_order_acquire))
+			return fn;
+		if(m_handle == nullptr)
+			throw std::runtime_error(std::string("Error: symbol not bound to a library: ") + m_name);
+		FunctionPtr fn = this->lookup(m_handle);
+		if(fn == nullptr)
+			throw std::runtime_error(std::string("Error: cannot resolve symbol: ") + m_name);
+		m_fn.store(fn, std::memory_order_release);
+		return fn;
+	}
+};
+
+/** Loads each shared library once, caching the handles by path, and binds
+ *  function tables (sets of Symbol) to them. The registry must outlive the
+ *  symbols bound through it, as the libraries are closed on destruction.
+ *
+ *  Usage:
+ *    Symbol<double (double)> cos{"cos"}, sin{"sin"};
+ *    registry.bind("libm.so.6", PluginRegistry::Eager, cos, sin);
+ *    double y = cos(0.5);
+ */
+class PluginRegistry{
+public:
+	enum Binding{
+		// Load with RTLD_NOW and resolve all symbols in bind(), which
+		// throws listing all missing symbols.
+		Eager,
+		// Load with RTLD_LAZY and resolve each symbol on its first call.
+		Lazy
+	};
+
+	/// Thread-safe. Returns the cached handle, loading the library on the
+	/// first request. Throws std::runtime_error if it cannot be loaded, or
+	/// if Eager is requested for a library already loaded with Lazy, as its
+	/// handle does not guarantee that all references were resolved.
+	auto open(const std::string& path, Binding binding = Eager) -> void* {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_libs.find(path);
+		if(it != m_libs.end()){
+			if(binding == Eager && it->second.binding == Lazy)
+				throw std::runtime_error("Error: library " + path + " already loaded with lazy binding");
+			return it->second.handle.get();
+		}
+		LibHandle handle = loadDLL(path, binding == Eager ? RTLD_NOW : RTLD_LAZY);
+		if(handle == nullptr){
+			const char* err = dlerror();
+			throw std::runtime_error("Error: cannot load library " + path + ": " + (err ? err : ""));
+		}
+		return m_libs.emplace(path, Library{std::move(handle), binding}).first->second.handle.get();
+	}
+
+	/// Bind all symbols or none: with Eager binding, the symbols are looked
+	/// up first and only changed if none is missing.
+	template<typename... Symbols>
+	auto bind(const std::string& path, Binding binding, Symbols&... symbols) -> void {
+		void* handle = this->open(path, binding);
+		if(binding == Lazy){
+			(symbols.commit(handle, nullptr), ...);
+			return;
+		}
+		auto fns = std::make_tuple(symbols.lookup(handle)...);
+		std::string missing;
+		std::apply([&](auto... fn){
+			for(auto [ok, name]: {std::make_pair(fn != nullptr, symbols.name())...})
+				if(!ok)
+					missing += std::string(missing.empty() ? "" : ", ") + name;
+		}, fns);
+		if(!missing.empty())
+			throw std::runtime_error("Error: missing symbols in " + path + ": " + missing);
+		std::apply([&](auto... fn){ (symbols.commit(handle, fn), ...); }, fns);
+	}
+
+	auto size() const -> size_t {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_libs.size();
+	}
+
+private:
+	struct Library{
+		LibHandle handle;
+		Binding   binding;
+	};
+	mutable std::mutex             m_mutex;
+	std::map<std::string, Library> m_libs;
+};
+
 template<class Container>
 auto printContainer(
 	const std::string& name,
@@ -117,7 +529,7 @@ int main(){
 	std::cout << nl << "EXPERIMENT 2 = Indirect method invocation" << nl;
 	std::cout << "--------------------------------------" << nl;
 	// Create function which invokes an object method, akin to command design pattern.
-	using MachineCommand = std::function<void (CNCMachine&)>;
+	using MachineCommand = Command<CNCMachine>;
 	auto commands = std::list<MachineCommand> {
 		 makeCommand(&CNCMachine::setSpeed, 10)
 		,makeCommand(&CNCMachine::setPosition, 10.0, -20.0)
@@ -131,7 +543,147 @@ int main(){
 		cmd(mach2);
 	}
 
-	std::cout << nl << "EXPERIMENT 3 = Dynamic Loading from shared library (libgslcblas.so) " << nl;
+	std::cout << nl << "EXPERIMENT 3 = Concurrent command execution for many machines" << nl;
+	std::cout << "--------------------------------------" << nl;
+	{
+		const size_t nmachines = 200;
+		const int    ncycles   = 4;
+		CNCMachine::verbose = false;
+		CNCMachine::ioDelay = std::chrono::microseconds(100);
+
+		// Each cycle: speed ramp, trajectory and one setSpeed between two moves
+		auto submitAll = [&](auto submit){
+			for(int c = 0; c < ncycles; c++){
+				for(size_t i = 0; i < nmachines; i++){
+					for(int k = 1; k <= 5; k++)
+						submit(i, makeCommand(&CNCMachine::setSpeed, k * 10 + c), CNCMachine::Speed);
+					for(int k = 1; k <= 5; k++)
+						submit(i, makeCommand(&CNCMachine::setPosition, 1.0 * k, 2.0 * c), CNCMachine::Position);
+					submit(i, makeCommand(&CNCMachine::setSpeed, 5), CNCMachine::Speed);
+					submit(i, makeCommand(&CNCMachine::setPosition, 0.0, 0.0), CNCMachine::Position);
+				}
+			}
+		};
+		auto makeMachines = [&]{
+			std::vector<CNCMachine> machines;
+			for(size_t i = 0; i < nmachines; i++)
+				machines.emplace_back("M" + std::to_string(i));
+			return machines;
+		};
+		auto ms = [](auto d){ return std::chrono::duration<double, std::milli>(d).count(); };
+
+		// Serial loop over the command lists
+		auto machines1 = makeMachines();
+		std::vector<std::vector<MachineCommand>> lists(nmachines);
+		submitAll([&](size_t i, MachineCommand cmd, int){ lists[i].push_back(std::move(cmd)); });
+		auto t0 = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < nmachines; i++)
+			for(const auto& cmd: lists[i])
+				cmd(machines1[i]);
+		auto t1 = std::chrono::steady_clock::now();
+
+		// Run the executor with 16 threads, with key 0 no command is coalesced.
+		// Thus the gain of parallelism and the gain of coalescing are measured
+		// separately.
+		auto runExecutor = [&](bool coalesce){
+			auto machines = makeMachines();
+			CommandExecutor<CNCMachine>::Stats st;
+			auto t2 = std::chrono::steady_clock::now();
+			{
+				CommandExecutor<CNCMachine> executor(machines, 16);
+				submitAll([&](size_t i, MachineCommand cmd, int key){
+					executor.submit(i, std::move(cmd), coalesce ? key : 0);
+				});
+				executor.waitIdle();
+				st = executor.stats();
+			}
+			auto t3 = std::chrono::steady_clock::now();
+			bool same = true;
+			for(size_t i = 0; i < nmachines; i++)
+				same = same && machines1[i].speed() == machines[i].speed()
+					&& machines1[i].x() == machines[i].x() && machines1[i].y() == machines[i].y();
+			return std::make_tuple(ms(t3 - t2), st, same);
+		};
+		auto printRun = [&](const char* label, double elapsed
+							, const CommandExecutor<CNCMachine>::Stats& st, bool same){
+			std::cout << label << elapsed << " ms" << nl;
+			std::cout << "   executed = " << st.executed << " ; coalesced = " << st.coalesced
+					  << " ; failed = " << st.failed << " ; same final state = "
+					  << std::boolalpha << same << nl;
+			std::cout << "   latency mean = " << st.meanUs << " us ; p50 <= " << st.p50Us
+					  << " us ; p99 <= " << st.p99Us << " us ; max = " << st.maxUs << " us" << nl;
+		};
+		double serial = ms(t1 - t0);
+		auto [parallel, st1, same1] = runExecutor(false);
+		auto [coalesced, st2, same2] = runExecutor(true);
+
+		std::cout << " Machines = " << nmachines << " ; commands = " << nmachines * ncycles * 12
+				  << " ; simulated I/O = " << CNCMachine::ioDelay.count() << " us/command" << nl;
+		std::cout << " Serial loop                       = " << serial << " ms" << nl;
+		printRun(" CommandExecutor (16), no coalesce = ", parallel, st1, same1);
+		printRun(" CommandExecutor (16), coalesce    = ", coalesced, st2, same2);
+		std::cout << " Speedup of parallelism = " << serial / parallel
+				  << " ; speedup of coalescing = " << parallel / coalesced << nl;
+		CNCMachine::verbose = true;
+		CNCMachine::ioDelay = std::chrono::microseconds(0);
+	}
+
+	std::cout << nl << "EXPERIMENT 4 = Plugin registry with cached symbol table" << nl;
+	std::cout << "--------------------------------------" << nl;
+	{
+		const std::string libm = "libm.so.6";
+		PluginRegistry registry;
+		// Function table of the plugin, resolved once
+		struct MathApi{
+			Symbol<double (double)>         cos{"cos"};
+			Symbol<double (double)>         exp{"exp"};
+			Symbol<double (double, double)> hypot{"hypot"};
+		} api;
+		registry.bind(libm, PluginRegistry::Eager, api.cos, api.exp, api.hypot);
+
+		Symbol<double (double)> lazySqrt{"sqrt"};
+		registry.bind(libm, PluginRegistry::Lazy, lazySqrt);
+		std::cout << " Libraries loaded = " << registry.size() << nl;
+		std::cout << " cos(0.5) = " << api.cos(0.5) << " ; hypot(3, 4) = " << api.hypot(3.0, 4.0) << nl;
+		std::cout << " sqrt resolved before call = " << std::boolalpha << lazySqrt.isResolved()
+				  << " ; sqrt(2) = " << lazySqrt(2.0)
+				  << " ; resolved after = " << lazySqrt.isResolved() << nl;
+
+		// A failed bind leaves all symbols unchanged
+		auto expBefore = api.exp.get();
+		try {
+			Symbol<double (double)> missing{"no_such_function"};
+			registry.bind(libm, PluginRegistry::Eager, api.exp, missing);
+		} catch(const std::runtime_error& ex) {
+			std::cout << " Expected error: " << ex.what() << nl;
+		}
+		std::cout << " exp unchanged after failed bind = " << (api.exp.get() == expBefore) << nl;
+
+		// Eager binding cannot reuse a handle opened with RTLD_LAZY
+		try {
+			Symbol<int (int)> abs{"abs"};
+			registry.bind("libc.so.6", PluginRegistry::Lazy, abs);
+			registry.bind("libc.so.6", PluginRegistry::Eager, abs);
+		} catch(const std::runtime_error& ex) {
+			std::cout << " Expected error: " << ex.what() << nl;
+		}
+
+		const int ncalls = 1000000;
+		auto handle = loadDLL(libm);
+		double sum1 = 0.0, sum2 = 0.0;
+		auto t0 = std::chrono::steady_clock::now();
+		for(int i = 0; i < ncalls; i++)
+			sum1 += loadSymbol<double (double)>(handle, "exp")(i * 1e-6);
+		auto t1 = std::chrono::steady_clock::now();
+		for(int i = 0; i < ncalls; i++)
+			sum2 += api.exp(i * 1e-6);
+		auto t2 = std::chrono::steady_clock::now();
+		auto ns = [&](auto d){ return std::chrono::duration<double, std::nano>(d).count() / ncalls; };
+		std::cout << " loadSymbol() per call = " << ns(t1 - t0) << " ns/call (sum = " << sum1 << ")" << nl;
+		std::cout << " Symbol table          = " << ns(t2 - t1) << " ns/call (sum = " << sum2 << ")" << nl;
+	}
+
+	std::cout << nl << "EXPERIMENT 5 = Dynamic Loading from shared library (libgslcblas.so) " << nl;
 	std::cout << "--------------------------------------" << nl;	
 
 	auto handle1 = loadDLL("/usr/lib64/libgslcblas.so");
@@ -1,12 +1,39 @@
 /*  File:   test_terminate.cpp 
  *  Author: Caio Rodrigues 
  *  Brief:  Override std::termiante_handler for understanding what happens during abnormal program termination.
+ *
+ *  Compile with: 
+ *   $ clang++ test_terminate.cpp -o term -std=c++1z -g -Wall -Wextra -g -lpthread -rdynamic
+ *
+ *  Write a minidump on crash (SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL or std::terminate):
+ *   $ env MINIDUMP=/tmp ./term crash_segv
+ *  Symbolize the minidump (uses addr2line):
+ *   $ ./term symbolize /tmp/crash-<PID>.dmp
  *----------------------------------------------------------------------------------------------*/
 
 #include <iostream>
 #include <string>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <csignal>
+#include <exception>
+
+// Unix specific 
+#include <unistd.h>
+#include <fcntl.h>
+#include <execinfo.h> // backtrace()
+#include <ucontext.h>
+#include <elf.h>
+#include <sys/wait.h>
 
 class DummyClass{
 public:
@@ -21,10 +48,395 @@ public:
 };
 
 
+/** Minidump binary format: a header followed by sections
+ *  of the sizes given in the header, in this order:
+ *    + uint64_t frames[numFrames]          - Return addresses (backtrace)
+ *    + uint64_t registers[numRegisters]    - See registerNames
+ *    + DumpEvent events[numEvents]         - Last events, oldest first
+ *    + char     maps[mapsSize]             - Copy of /proc/self/maps 
+ */
+struct DumpHeader{
+    char     magic[8];       // "CPPDUMP1"
+    int32_t  signal;         // 0 for std::terminate() 
+    int32_t  pid;
+    int64_t  timestamp;      // Unix time in seconds 
+    uint64_t faultAddress;   // siginfo_t::si_addr 
+    uint32_t numFrames;
+    uint32_t numRegisters;
+    uint32_t numEvents;
+    uint32_t mapsSize;
+};
+
+struct DumpEvent{
+    int64_t timestamp;       // CLOCK_REALTIME in nanoseconds
+    char    text[120];
+};
+
+#if defined(__x86_64__)
+static const char* const registerNames[] = {
+    "rip", "rsp", "rbp", "rax", "rbx", "rcx", "rdx", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "eflags"
+};
+#elif defined(__aarch64__)
+static const char* const registerNames[] = { "pc", "sp", "x29(fp)", "x30(lr)", "x0", "x1", "x2", "x3" };
+#else
+static const char* const registerNames[] = { nullptr };
+#endif
+
+/** Crash handler which writes a minidump when the process receives a fatal
+ *  signal or calls std::terminate().
+ *
+ *  Only async-signal-safe functions are called in the signal handler
+ *  (open, read, write, close, clock_gettime, getpid). The dump is built in a
+ *  statically allocated buffer and the handler runs on an alternate signal
+ *  stack, so it works after a stack overflow or heap corruption.
+ *  backtrace() is called once during installation, as the first call may
+ *  load libgcc_s and allocate memory.
+ *
+ *  There is no cost on the hot path besides record(), which writes an entry
+ *  into an in-memory ring of the last events.
+ */
+class CrashHandler{
+public:
+    static constexpr size_t maxFrames = 64;
+    static constexpr size_t numEvents = 32;
+    static constexpr size_t bufferSize = 256 * 1024;
+
+    /// Install signal handlers and std::terminate handler. The dump is
+    /// written to <directory>/crash-<PID>.dmp 
+    static void install(const char* directory){
+        State& st = state();
+        std::snprintf(st.directory, sizeof(st.directory), "%s", directory);
+        // Warm up backtrace()
+        void* frames[4];
+        ::backtrace(frames, 4);
+
+        stack_t ss;
+        ss.ss_sp    = st.altStack;
+        ss.ss_size  = sizeof(st.altStack);
+        ss.ss_flags = 0;
+        ::sigaltstack(&ss, nullptr);
+
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = &CrashHandler::onSignal;
+        sa.sa_flags     = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+        sigemptyset(&sa.sa_mask);
+        for(int sig: {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL})
+            ::sigaction(sig, &sa, nullptr);
+
+        std::set_terminate(&CrashHandler::onTerminate);
+    }
+
+    /// Record an event in the ring buffer (printf-like format).
+    /// Thread-safe, but a crash during an update may leave one entry incomplete.
+    static void record(const char* format, ...){
+        State& st = state();
+        size_t n = st.eventCount.fetch_add(1, std::memory_order_relaxed);
+        DumpEvent& ev = st.events[n % numEvents];
+        struct timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        ev.timestamp = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(ev.text, sizeof(ev.text), format, args);
+        va_end(args);
+    }
+
+    /// Print a minidump with symbols resolved by addr2line (offline tool).
+    static int symbolize(const char* file);
+
+private:
+    struct State{
+        char                directory[256] = ".";
+        alignas(16) char    altStack[64 * 1024];
+        alignas(16) char    buffer[bufferSize];
+        DumpEvent           events[numEvents];
+        std::atomic<size_t> eventCount{0};
+        std::atomic<bool>   dumped{false};
+    };
+
+    static State& state(){
+        static State st;
+        return st;
+    }
+
+    static void onSignal(int sig, siginfo_t* info, void* context){
+        writeDump(sig, info->si_addr, static_cast<ucontext_t*>(context));
+        // SA_RESETHAND restored the default action: re-raise to terminate
+        // the process with the original signal (and core dump).
+        ::raise(sig);
+    }
+
+    static void onTerminate(){
+        State& st = state();
+        if(auto eptr = std::current_exception()){
+            try { std::rethrow_exception(eptr); }
+            catch(const std::exception& ex){ record("terminate: uncaught exception: %s", ex.what()); }
+            catch(...){ record("terminate: uncaught unknown exception"); }
+        } else {
+            record("terminate: called without active exception");
+        }
+        writeDump(0, nullptr, nullptr);
+        // Avoid a second dump from SIGABRT 
+        st.dumped = true;
+        std::signal(SIGABRT, SIG_DFL);
+        std::abort();
+    }
+
+    /// Append bytes to the dump buffer, truncating on overflow 
+    static void append(size_t& pos, const void* data, size_t size){
+        if(pos + size > bufferSize) size = bufferSize - pos;
+        std::memcpy(state().buffer + pos, data, size);
+        pos += size;
+    }
+
+    /// Async-signal-safe unsigned integer to decimal string 
+    static char* formatUInt(char* out, unsigned long value){
+        char tmp[24];
+        int n = 0;
+        do { tmp[n++] = '0' + value % 10; value /= 10; } while(value != 0);
+        while(n > 0) *out++ = tmp[--n];
+        *out = '\0';
+        return out;
+    }
+
+    static void writeDump(int sig, void* faultAddress, ucontext_t* context){
+        State& st = state();
+        if(st.dumped.exchange(true)) return;
+
+        DumpHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "CPPDUMP1", 8);
+        header.signal       = sig;
+        header.pid          = ::getpid();
+        struct timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        header.timestamp    = ts.tv_sec;
+        header.faultAddress = reinterpret_cast<uintptr_t>(faultAddress);
+
+        void* frames[maxFrames];
+        header.numFrames = ::backtrace(frames, maxFrames);
+
+        uint64_t regs[sizeof(registerNames) / sizeof(registerNames[0])] = {};
+        header.numRegisters = 0;
+        if(context != nullptr){
+            #if defined(__x86_64__)
+            const greg_t* g = context->uc_mcontext.gregs;
+            const int index[] = { REG_RIP, REG_RSP, REG_RBP, REG_RAX, REG_RBX, REG_RCX
+                                  , REG_RDX, REG_RSI, REG_RDI, REG_R8, REG_R9, REG_R10
+                                  , REG_R11, REG_R12, REG_R13, REG_R14, REG_R15, REG_EFL };
+            for(size_t i = 0; i < sizeof(index) / sizeof(index[0]); i++)
+                regs[i] = static_cast<uint64_t>(g[index[i]]);
+            header.numRegisters = sizeof(index) / sizeof(index[0]);
+            #elif defined(__aarch64__)
+            const auto& m = context->uc_mcontext;
+            const uint64_t values[] = { m.pc, m.sp, m.regs[29], m.regs[30]
+                                        , m.regs[0], m.regs[1], m.regs[2], m.regs[3] };
+            for(size_t i = 0; i < 8; i++) regs[i] = values[i];
+            header.numRegisters = 8;
+            #endif
+        }
+
+        size_t count = st.eventCount.load(std::memory_order_relaxed);
+        header.numEvents = count < numEvents ? count : numEvents;
+
+        // Sections are written after the header, which is written last
+        // once the size of maps is known.
+        size_t pos = sizeof(DumpHeader);
+        for(uint32_t i = 0; i < header.numFrames; i++){
+            uint64_t addr = reinterpret_cast<uintptr_t>(frames[i]);
+            append(pos, &addr, sizeof(addr));
+        }
+        append(pos, regs, header.numRegisters * sizeof(uint64_t));
+        for(size_t i = count - header.numEvents; i < count; i++)
+            append(pos, &st.events[i % numEvents], sizeof(DumpEvent));
+
+        // Loaded modules
+        size_t mapsStart = pos;
+        int mfd = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        if(mfd >= 0){
+            ssize_t n;
+            while(pos < bufferSize
+                  && (n = ::read(mfd, st.buffer + pos, bufferSize - pos)) > 0)
+                pos += n;
+            ::close(mfd);
+        }
+        header.mapsSize = static_cast<uint32_t>(pos - mapsStart);
+        std::memcpy(st.buffer, &header, sizeof(header));
+
+        // File name: <directory>/crash-<pid>.dmp
+        char path[320];
+        char* p = path;
+        for(const char* d = st.directory; *d != '\0' && p < path + 256; d++) *p++ = *d;
+        std::memcpy(p, "/crash-", 7); p += 7;
+        p = formatUInt(p, static_cast<unsigned long>(header.pid));
+        std::memcpy(p, ".dmp", 5);
+
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd >= 0){
+            size_t done = 0;
+            while(done < pos){
+                ssize_t n = ::write(fd, st.buffer + done, pos - done);
+                if(n <= 0) break;
+                done += n;
+            }
+            ::close(fd);
+        }
+        const char msg[] = " [FATAL] Crash - minidump written to: ";
+        ::write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        ::write(STDERR_FILENO, path, std::strlen(path));
+        ::write(STDERR_FILENO, "\n", 1);
+    }
+
+};
+
+/// Module (shared library or executable) mapped in the crashed process 
+struct DumpModule{
+    uint64_t    start;
+    uint64_t    end;
+    uint64_t    base;     // Address where offset 0 of the file was mapped
+    std::string path;
+};
+
+/// Runs "addr2line -f -C -e <path> <address>" without a shell, as the path
+/// comes from the dump file. Returns false if addr2line cannot be run.
+static bool addr2line(const std::string& path, uint64_t address
+                      , std::string& function, std::string& location){
+    char addr[32];
+    std::snprintf(addr, sizeof(addr), "0x%llx", static_cast<unsigned long long>(address));
+    const char* argv[] = { "addr2line", "-f", "-C", "-e", path.c_str(), addr, nullptr };
+    int fds[2];
+    if(::pipe2(fds, O_CLOEXEC) < 0)
+        return false;
+    pid_t pid = ::fork();
+    if(pid < 0){
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    if(pid == 0){
+        ::dup2(fds[1], STDOUT_FILENO);
+        int devnull = ::open("/dev/null", O_WRONLY);
+        if(devnull >= 0)
+            ::dup2(devnull, STDERR_FILENO);
+        ::execvp(argv[0], const_cast<char* const*>(argv));
+        ::_exit(127);
+    }
+    ::close(fds[1]);
+    if(FILE* out = ::fdopen(fds[0], "r")){
+        char buf[1024];
+        if(std::fgets(buf, sizeof(buf), out)) function = std::string(buf, std::strcspn(buf, "\n"));
+        if(std::fgets(buf, sizeof(buf), out)) location = std::string(buf, std::strcspn(buf, "\n"));
+        std::fclose(out);
+    } else
+        ::close(fds[0]);
+    int status;
+    ::waitpid(pid, &status, 0);
+    return true;
+}
+
+int CrashHandler::symbolize(const char* file){
+    std::ifstream fs(file, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+    DumpHeader h;
+    if(data.size() < sizeof(h) || std::memcmp(data.data(), "CPPDUMP1", 8) != 0){
+        std::cerr << " [ERROR] Invalid minidump file: " << file << "\n";
+        return 1;
+    }
+    std::memcpy(&h, data.data(), sizeof(h));
+    // Counts come from the file: bound them before sizing or indexing anything
+    if(h.numFrames > maxFrames || h.numEvents > numEvents
+       || h.numRegisters > sizeof(registerNames) / sizeof(registerNames[0])
+       || (h.numRegisters > 0 && registerNames[0] == nullptr)){
+        std::cerr << " [ERROR] Corrupt minidump header: " << file << "\n";
+        return 1;
+    }
+    size_t expected = sizeof(h) + (h.numFrames + h.numRegisters) * sizeof(uint64_t)
+        + h.numEvents * sizeof(DumpEvent) + h.mapsSize;
+    if(data.size() < expected){
+        std::cerr << " [ERROR] Truncated minidump file: " << file << "\n";
+        return 1;
+    }
+    const char* p = data.data() + sizeof(h);
+    std::vector<uint64_t> frames(h.numFrames), regs(h.numRegisters);
+    std::memcpy(frames.data(), p, frames.size() * 8); p += frames.size() * 8;
+    std::memcpy(regs.data(), p, regs.size() * 8);     p += regs.size() * 8;
+    std::vector<DumpEvent> events(h.numEvents);
+    std::memcpy(events.data(), p, events.size() * sizeof(DumpEvent));
+    p += events.size() * sizeof(DumpEvent);
+    std::string maps(p, h.mapsSize);
+
+    // Parse lines "start-end perms offset dev inode path"
+    std::vector<DumpModule> modules;
+    std::istringstream ms(maps);
+    std::string line;
+    while(std::getline(ms, line)){
+        unsigned long start, end, offset;
+        char perms[8], path[512] = "";
+        if(std::sscanf(line.c_str(), "%lx-%lx %7s %lx %*s %*s %511s"
+                       , &start, &end, perms, &offset, path) < 4 || path[0] != '/')
+            continue;
+        modules.push_back(DumpModule{start, end, start - offset, path});
+    }
+
+    std::printf(" Signal       = %d (%s)\n", h.signal
+                , h.signal == 0 ? "std::terminate" : ::strsignal(h.signal));
+    std::printf(" PID          = %d\n", h.pid);
+    std::printf(" Timestamp    = %lld\n", static_cast<long long>(h.timestamp));
+    std::printf(" Fault addr   = 0x%llx\n", static_cast<unsigned long long>(h.faultAddress));
+    std::puts("\n Registers:");
+    for(size_t i = 0; i < regs.size(); i++)
+        std::printf("  %-8s = 0x%016llx\n", registerNames[i], static_cast<unsigned long long>(regs[i]));
+
+    std::puts("\n Last events:");
+    for(const auto& ev: events)
+        std::printf("  [%lld.%09lld] %.*s\n", static_cast<long long>(ev.timestamp / 1000000000)
+                    , static_cast<long long>(ev.timestamp % 1000000000)
+                    , static_cast<int>(sizeof(ev.text)), ev.text);
+
+    std::puts("\n Stack trace:");
+    for(size_t i = 0; i < frames.size(); i++){
+        uint64_t addr = frames[i];
+        const DumpModule* mod = nullptr;
+        for(const auto& m: modules)
+            if(addr >= m.start && addr < m.end){ mod = &m; break; }
+        if(mod == nullptr){
+            std::printf("  #%-2zu 0x%016llx ??\n", i, static_cast<unsigned long long>(addr));
+            continue;
+        }
+        // Shared objects and PIE executables (ET_DYN) are symbolized with
+        // the address relative to the load base, ET_EXEC with the absolute one.
+        uint64_t rel = addr - mod->base;
+        std::ifstream elf(mod->path, std::ios::binary);
+        Elf64_Ehdr ehdr;
+        if(elf.read(reinterpret_cast<char*>(&ehdr), sizeof(ehdr)) && ehdr.e_type == ET_EXEC)
+            rel = addr;
+        // Return addresses point after the call instruction
+        uint64_t lookup = i > 0 ? rel - 1 : rel;
+        std::string function = "??", location = "??";
+        addr2line(mod->path, lookup, function, location);
+        std::printf("  #%-2zu 0x%016llx %s+0x%llx\n       %s at %s\n", i
+                    , static_cast<unsigned long long>(addr), mod->path.c_str()
+                    , static_cast<unsigned long long>(rel), function.c_str(), location.c_str());
+    }
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
+    if(argc == 3 && std::string(argv[1]) == "symbolize")
+        return CrashHandler::symbolize(argv[2]);
+
     DummyClass cls;
 
+    if(const char* dir = std::getenv("MINIDUMP"))
+    {
+        std::printf(" [TRACE] Install crash handler, minidump directory = %s\n", dir);
+        CrashHandler::install(dir);
+    }
+    CrashHandler::record("main: started with %d arguments", argc);
+
     const char* option = std::getenv("TERMINATE");
     if(option != nullptr && std::string(option) == "true")
     {
@@ -54,6 +466,7 @@ int main(int argc, char** argv)
         return 1;
     }
     std::string cmd = argv[1];
+    CrashHandler::record("main: command = %s", cmd.c_str());
 
     if(cmd == "terminate_normal1")
     {
@@ -85,6 +498,17 @@ int main(int argc, char** argv)
         // Missing thread::join() or thread::detach method call
         // => The runtime calls std::terminate()
     }
+    else if (cmd == "crash_segv")
+    {
+        std::puts(" [TRACE] Dereference null pointer");
+        volatile int* ptr = nullptr;
+        *ptr = 10;
+    }
+    else if (cmd == "crash_abort")
+    {
+        std::puts(" [TRACE] Call std::abort()");
+        std::abort();
+    }
 
     std::cout  << " [TRACE] End of main function" << std::endl;
 